@@ -0,0 +1,231 @@
+#include "Corpus.hpp"
+
+static const char* const arithOps[] = {" + ", " - "};
+static const char* const compareOps[] = {" < ", " > ", " == ", " != ", " <= ", " >= "};
+
+CorpusGenerator::CorpusGenerator(const CorpusOptions& o):
+	opt(o), state(o.seed * 0x9E3779B97F4A7C15ull + 1), fn(0), names(0), loops(0), called(false)
+{}
+
+//xorshift64*, so a seed gives the same program everywhere
+unsigned CorpusGenerator::next(unsigned n)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (unsigned)((state * 0x2545F4914F6CDD1Dull) >> 32) % n;
+}
+
+void CorpusGenerator::indent(int depth)
+{
+	out.append(2 * depth, ' ');
+}
+
+std::string CorpusGenerator::newName(char prefix)
+{
+	return prefix + std::to_string((long long)names++);
+}
+
+//A variable in scope, empty if there is none
+std::string CorpusGenerator::variable(bool writable)
+{
+	size_t count = 0;
+	for(size_t i=0; i<scopes.size(); i++) count += scopes[i].size();
+	if(!writable) count += readOnly.size();
+	if(count == 0) return "";
+
+	size_t pick = next(count);
+	for(size_t i=0; i<scopes.size(); i++){
+		if(pick < scopes[i].size()) return scopes[i][pick];
+		pick -= scopes[i].size();
+	}
+	return readOnly[pick];
+}
+
+std::string CorpusGenerator::expression(int depth)
+{
+	if(depth <= 0 || next(4) == 0){
+		std::string v = variable(false);
+		if(v.empty() || next(3) == 0) return std::to_string((long long)next(100));
+		return v;
+	}
+
+	std::string l = expression(depth - 1);
+	std::string r = expression(depth - 1);
+	if(l.find(' ') != std::string::npos) l = "(" + l + ")";
+	if(r.find(' ') != std::string::npos) r = "(" + r + ")";
+	return l + arithOps[next(2)] + r;
+}
+
+std::string CorpusGenerator::condition()
+{
+	int depth = opt.exprDepth > 1 ? opt.exprDepth - 1 : 1;
+	return expression(depth) + compareOps[next(6)] + expression(depth);
+}
+
+std::string CorpusGenerator::call(int callee)
+{
+	std::string s = "f" + std::to_string((long long)callee) + "(";
+	for(int i=0; i<arity[callee]; i++){
+		if(i) s += ", ";
+		s += expression(1);
+	}
+	return s + ")";
+}
+
+void CorpusGenerator::statement(int depth, int& budget)
+{
+	budget--;
+	bool compound = depth <= opt.nesting && budget > 0;
+
+	unsigned kind = next(10);
+	if(compound && kind < 2){
+		int inner = 1 + next(budget < 8 ? budget : 8);
+		budget -= inner;
+		int elseBudget = 0;
+		if(inner > 1 && next(2)){
+			elseBudget = inner / 2;
+			inner -= elseBudget;
+		}
+		indent(depth);
+		out += "if(" + condition() + ")\n";
+		block(depth, inner);
+		if(elseBudget){
+			indent(depth);
+			out += "else\n";
+			block(depth, elseBudget);
+		}
+		return;
+	}
+
+	if(compound && kind < 4){
+		int inner = 1 + next(budget < 8 ? budget : 8);
+		budget -= inner;
+		std::string counter = newName('c');
+		std::string bound = std::to_string((long long)(2 + next(3)));
+		indent(depth);
+		loops++;
+		if(kind == 2){
+			out += "int " + counter + " = 0;\n";
+			indent(depth);
+			out += "while(" + counter + " < " + bound + ")\n";
+			readOnly.push_back(counter);
+			block(depth, inner, counter + " = " + counter + " + 1;");
+		}
+		else{
+			out += "int " + counter + ";\n";
+			indent(depth);
+			out += "for(" + counter + " = 0; " + counter + " < " + bound + "; " + counter + " = " + counter + " + 1)\n";
+			readOnly.push_back(counter);
+			block(depth, inner);
+		}
+		loops--;
+		return;
+	}
+
+	std::string target = variable(true);
+	if(kind < 5 && fn > 0 && !called && loops == 0 && !target.empty()){
+		called = true;
+		indent(depth);
+		out += target + " = " + call(next(fn)) + ";\n";
+		return;
+	}
+
+	if(kind < 9 && !target.empty()){
+		indent(depth);
+		out += target + " = " + expression(opt.exprDepth) + ";\n";
+		return;
+	}
+
+	int args = 1 + next(3);
+	std::string format = "f" + std::to_string((long long)fn) + "." + std::to_string((long long)names++);
+	std::string list;
+	for(int i=0; i<args; i++){
+		format += " %d";
+		list += ", " + expression(1);
+	}
+	indent(depth);
+	out += "printf(\"" + format + "\\n\"" + list + ");\n";
+}
+
+void CorpusGenerator::block(int depth, int budget, const std::string& last)
+{
+	size_t readOnlyMark = readOnly.size();
+
+	indent(depth);
+	out += "{\n";
+	scopes.push_back(std::vector<std::string>());
+	for(int i=0; i<opt.locals; i++){
+		std::string v = newName('v');
+		indent(depth + 1);
+		out += "int " + v + " = " + expression(opt.exprDepth) + ";\n";
+		scopes.back().push_back(v);
+	}
+	while(budget > 0){
+		statement(depth + 1, budget);
+	}
+	if(!last.empty()){
+		indent(depth + 1);
+		out += last + "\n";
+	}
+	scopes.pop_back();
+	indent(depth);
+	out += "}\n";
+
+	//Loop counters declared in this block go out of scope with it
+	if(readOnly.size() > readOnlyMark) readOnly.resize(readOnlyMark);
+}
+
+void CorpusGenerator::function()
+{
+	int params = fn % 5;
+	names = 0;
+	called = false;
+	readOnly.clear();
+
+	out += "int f" + std::to_string((long long)fn) + "(";
+	for(int i=0; i<params; i++){
+		std::string p = newName('p');
+		if(i) out += ", ";
+		out += "int " + p;
+		readOnly.push_back(p);
+	}
+	out += ")\n{\n";
+
+	scopes.push_back(std::vector<std::string>());
+	for(int i=0; i<opt.locals; i++){
+		std::string v = newName('v');
+		out += "  int " + v + " = " + expression(opt.exprDepth) + ";\n";
+		scopes.back().push_back(v);
+	}
+	int budget = opt.stmts;
+	while(budget > 0){
+		statement(1, budget);
+	}
+	out += "  return " + expression(opt.exprDepth) + ";\n";
+	scopes.pop_back();
+	out += "}\n\n";
+
+	arity.push_back(params);
+	fn++;
+}
+
+std::string CorpusGenerator::generate()
+{
+	out.clear();
+	arity.clear();
+	fn = 0;
+
+	for(int i=0; i<opt.functions; i++){
+		function();
+	}
+
+	out += "int main()\n{\n";
+	if(fn > 0){
+		names = 0;
+		readOnly.clear();
+		out += "  printf(\"%d\\n\", " + call(fn - 1) + ");\n";
+	}
+	out += "  return 0;\n}\n";
+	return out;
+}
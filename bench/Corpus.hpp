@@ -0,0 +1,60 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+Knobs for the synthetic C generator. Every statement of a function counts
+towards stmts, including the ones nested inside ifs and loops.
+*/
+struct CorpusOptions
+{
+	int functions = 100;
+	int stmts = 20;		//Statements per function
+	int exprDepth = 3;	//Operator nesting of expressions
+	int nesting = 2;	//Depth of if/else and loop blocks
+	int locals = 4;		//Variables declared at the start of each scope
+	uint32_t seed = 1;
+};
+
+/*
+Produces programs in the subset ucc supports: int locals, if/else, while
+and for loops, + and -, comparisons, calls with up to 4 arguments and
+printf. The output only depends on the options, and the programs terminate:
+loop counters are never assigned in the loop body, and every function makes
+at most one call, outside any loop, to a function defined before it.
+*/
+class CorpusGenerator
+{
+	CorpusOptions opt;
+	uint64_t state;
+	std::string out;
+
+	std::vector<std::vector<std::string> > scopes;	//Variables that may be assigned
+	std::vector<std::string> readOnly;	//Parameters and loop counters in scope
+	std::vector<int> arity;	//Parameter count of each function so far
+	int fn;
+	int names;
+	int loops;	//Loops around the statement being generated
+	bool called;
+
+	unsigned next(unsigned n);
+	void indent(int depth);
+	std::string newName(char prefix);
+	std::string variable(bool writable);
+	std::string expression(int depth);
+	std::string condition();
+	std::string call(int callee);
+	void statement(int depth, int& budget);
+	void block(int depth, int budget, const std::string& last = "");
+	void function();
+
+public:
+	CorpusGenerator(const CorpusOptions& o);
+
+	std::string generate();
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+End to end compile throughput. Generates a synthetic program for each size
+tier, compiles it repeatedly with ucc and reports the best time, lines per
+second and peak RSS of each tier, and how the time grows with the input: an
+exponent of 1 is linear, anything well above it points at superlinear
+behaviour somewhere in the compiler.
+
+usage: compilebench [--ucc path] [--reps N] [--tiers N,N,...]
+                    [--stmts N] [--expr-depth N] [--nesting N] [--locals N]
+                    [--seed N] [--max-exponent X] [-- ucc flags...]
+
+Tiers are numbers of functions. With --max-exponent the exit status is 2 if
+the fitted exponent is above X.
+*/
+#include "Corpus.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+struct Run
+{
+	double ms;
+	long maxRssKb;
+	bool ok;
+};
+
+//Runs ucc once, its stdout and stderr go to /dev/null
+static Run compile(const std::string& ucc, const std::vector<std::string>& args)
+{
+	std::vector<char*> argv;
+	argv.push_back(const_cast<char*>(ucc.c_str()));
+	for(size_t i=0; i<args.size(); i++){
+		argv.push_back(const_cast<char*>(args[i].c_str()));
+	}
+	argv.push_back(NULL);
+
+	Run r = {0, 0, false};
+	auto start = std::chrono::steady_clock::now();
+	pid_t pid = fork();
+	if(pid < 0) return r;
+	if(pid == 0){
+		int devnull = open("/dev/null", O_WRONLY);
+		dup2(devnull, 1);
+		dup2(devnull, 2);
+		execv(argv[0], argv.data());
+		_exit(127);
+	}
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) < 0) return r;
+	std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+
+	r.ms = d.count();
+	r.maxRssKb = usage.ru_maxrss;
+	r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	return r;
+}
+
+static std::vector<int> parseTiers(const char* s)
+{
+	std::vector<int> tiers;
+	while(*s){
+		char* end;
+		long n = strtol(s, &end, 10);
+		if(end == s || n <= 0) return std::vector<int>();
+		tiers.push_back(n);
+		s = *end == ',' ? end + 1 : end;
+	}
+	return tiers;
+}
+
+static int usage()
+{
+	std::cerr << "usage: compilebench [--ucc path] [--reps N] [--tiers N,N,...] [--stmts N] [--expr-depth N]"
+		" [--nesting N] [--locals N] [--seed N] [--max-exponent X] [-- ucc flags...]" << std::endl;
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	std::string ucc = "../bin/compiler";
+	int reps = 3;
+	double maxExponent = 0;
+	std::vector<int> tiers = {16, 64, 256, 1024, 4096};
+	std::vector<std::string> extra;
+	CorpusOptions opt;
+
+	for(int i=1; i<argc; i++){
+		if(strcmp(argv[i], "--") == 0){
+			for(i++; i<argc; i++) extra.push_back(argv[i]);
+			break;
+		}
+		if(i+1 >= argc) return usage();
+
+		const char* v = argv[++i];
+		if(strcmp(argv[i-1], "--ucc") == 0) ucc = v;
+		else if(strcmp(argv[i-1], "--reps") == 0) reps = atoi(v);
+		else if(strcmp(argv[i-1], "--tiers") == 0) tiers = parseTiers(v);
+		else if(strcmp(argv[i-1], "--stmts") == 0) opt.stmts = atoi(v);
+		else if(strcmp(argv[i-1], "--expr-depth") == 0) opt.exprDepth = atoi(v);
+		else if(strcmp(argv[i-1], "--nesting") == 0) opt.nesting = atoi(v);
+		else if(strcmp(argv[i-1], "--locals") == 0) opt.locals = atoi(v);
+		else if(strcmp(argv[i-1], "--seed") == 0) opt.seed = strtoul(v, NULL, 10);
+		else if(strcmp(argv[i-1], "--max-exponent") == 0) maxExponent = atof(v);
+		else return usage();
+	}
+	if(reps < 1 || tiers.empty()) return usage();
+
+	char dirName[] = "/tmp/compilebenchXXXXXX";
+	if(mkdtemp(dirName) == NULL){
+		std::cerr << "Could not create a temporary directory" << std::endl;
+		return 1;
+	}
+	std::string dir = dirName;
+	std::string source = dir + "/tier.c";
+	std::string output = dir + "/tier.s";
+
+	std::vector<std::string> args = {"-S", "-c", output, source};
+	args.insert(args.end(), extra.begin(), extra.end());
+
+	printf("%10s %10s %10s %12s %14s %10s %9s\n", "functions", "lines", "KiB", "best ms", "lines/s", "RSS MiB", "exponent");
+
+	std::vector<double> logLines, logMs;
+	bool failed = false;
+	double prevLines = 0, prevMs = 0;
+
+	for(size_t t=0; t<tiers.size() && !failed; t++){
+		opt.functions = tiers[t];
+		CorpusGenerator gen(opt);
+		std::string program = gen.generate();
+		{
+			std::ofstream out(source.c_str());
+			out << program;
+		}
+		double lines = 0;
+		for(size_t i=0; i<program.size(); i++) lines += program[i] == '\n';
+
+		double best = 1e30;
+		long rss = 0;
+		for(int r=0; r<reps; r++){
+			Run run = compile(ucc, args);
+			if(!run.ok){
+				std::cerr << ucc << " failed on the " << tiers[t] << " function tier, kept in " << source << std::endl;
+				failed = true;
+				break;
+			}
+			if(run.ms < best) best = run.ms;
+			if(run.maxRssKb > rss) rss = run.maxRssKb;
+		}
+		if(failed) break;
+
+		char exponent[16] = "-";
+		if(prevLines > 0) snprintf(exponent, sizeof(exponent), "%.2f", log(best / prevMs) / log(lines / prevLines));
+		printf("%10d %10.0f %10.0f %12.2f %14.0f %10.1f %9s\n", tiers[t], lines, program.size() / 1024.0,
+			best, lines / (best / 1000), rss / 1024.0, exponent);
+		fflush(stdout);
+
+		logLines.push_back(log(lines));
+		logMs.push_back(log(best));
+		prevLines = lines;
+		prevMs = best;
+	}
+
+	if(failed) return 1;
+
+	unlink(source.c_str());
+	unlink(output.c_str());
+	rmdir(dir.c_str());
+
+	//Least squares slope of log(time) against log(lines)
+	if(logLines.size() < 2) return 0;
+	double n = logLines.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for(size_t i=0; i<logLines.size(); i++){
+		sx += logLines[i];
+		sy += logMs[i];
+		sxx += logLines[i] * logLines[i];
+		sxy += logLines[i] * logMs[i];
+	}
+	double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+	printf("time grows as lines^%.2f\n", slope);
+
+	if(maxExponent > 0 && slope > maxExponent){
+		printf("superlinear: exponent %.2f is above %.2f\n", slope, maxExponent);
+		return 2;
+	}
+	return 0;
+}
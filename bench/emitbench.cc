@@ -0,0 +1,268 @@
+/*
+Compares the two ways of printing assembly on a synthetic instruction
+stream: CodeGen::emit, which formats into the AsmWriter buffer, and format
+below, the std::string per line through an ostream printer emit replaced.
+Both are first checked against the text in expected below for one
+instruction of every form.
+
+usage: emitbench [instructions] [repetitions]
+*/
+#include "Compilation.hpp"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* const flagNames[] = {"EQ", "NE", "MI", "PL", "GT", "LT", "GE", "LE", "", ""};
+
+static const char* const opNames[] = {"MOV", "MVN", "ADD", "SUB", "RSB", "AND", "ORR", "CMP", "MUL", "MLA", "STR", "LDR", "LDR", "LDR"};
+
+static std::string reg(int r)
+{
+	return "r" + std::to_string((long long)r);
+}
+
+static std::string op2(const Instr& i)
+{
+	if(i.immOperand()) return "#" + std::to_string((long long)i.imm);
+	if(i.imm != 0) return reg(i.rm) + ", LSL #" + std::to_string((long long)i.imm);
+	return reg(i.rm);
+}
+
+static std::string render(const Instr& i)
+{
+	switch(i.op){
+		case OP_ADD:
+		case OP_SUB:
+		case OP_RSB:
+		case OP_AND:
+		case OP_ORR:
+			return std::string("    ") + opNames[i.op] + flagNames[i.cond] + " " + reg(i.rd) + ", " + reg(i.rn) + ", " + op2(i);
+		case OP_MOV:
+		case OP_MVN:
+			return std::string("    ") + opNames[i.op] + flagNames[i.cond] + " " + reg(i.rd) + ", " + op2(i);
+		case OP_CMP:
+			return std::string("    CMP ") + reg(i.rn) + ", " + op2(i);
+		case OP_MUL:
+		case OP_MLA:
+		{
+			std::string out = std::string("    ") + opNames[i.op] + flagNames[i.cond] + " " + reg(i.rd) + ", " + reg(i.rn) + ", " + reg(i.rm);
+			if(i.accumulates()) out += ", " + reg(i.imm);
+			return out;
+		}
+		case OP_STR:
+		case OP_LDR:
+			return std::string("    ") + opNames[i.op] + flagNames[i.cond] + " " + reg(i.rd) + ", [" + (i.rn == 13 ? "sp" : "fp") + ", #" + std::to_string((long long)i.imm) + "]";
+		case OP_LDRLIT:
+			return std::string("    LDR") + flagNames[i.cond] + " " + reg(i.rd) + ", =" + LabelAlloc::name(i.imm);
+		case OP_LDRCONST:
+			return std::string("    LDR") + flagNames[i.cond] + " " + reg(i.rd) + ", =" + std::to_string((long long)i.imm);
+		case OP_PUSH:
+		case OP_POP:
+		{
+			std::string out = (i.op == OP_PUSH) ? "    STMFD sp!, {" : "    LDMFD sp!, {";
+			bool first = true;
+			for(int r=0; r<16; r++){
+				if(!(i.regList & (1 << r))) continue;
+				if(!first) out += ", ";
+				out += reg(r);
+				first = false;
+			}
+			return out + "}";
+		}
+		case OP_B:
+			return std::string("    B") + flagNames[i.cond] + " " + LabelAlloc::name(i.imm);
+		case OP_BL:
+			return "    BL " + LabelAlloc::name(i.imm);
+		case OP_LABEL:
+			return LabelAlloc::name(i.imm) + ":";
+		case OP_GLOBAL:
+			return "    .global " + LabelAlloc::name(i.imm);
+		case OP_TEXT:
+			return CodeGen::text()[i.imm];
+	}
+	assert(false);
+	return "";
+}
+
+//The printer emit replaced, kept as the baseline it is measured against
+static void format(std::ostream& output)
+{
+	const std::vector<Instr>& instrs = CodeGen::instructions();
+	for(size_t k=0; k<instrs.size(); k++){
+		output << render(instrs[k]) << "\n";
+	}
+}
+
+//A mix of instructions in roughly the proportions the compiler produces
+static void fill(size_t n)
+{
+	Label printf = LabelAlloc::named("printf");
+	Label literal = LabelAlloc::literal(0);
+	CodeGen::push(TextBlock(".section .rodata\n.literal_0:\n.asciz \"%d\"\n.text\n"));
+
+	size_t i = 0;
+	while(i < n){
+		Label l = LabelAlloc::allocate();
+		CodeGen::push(LabelBlock(l));
+		CodeGen::push(StackOp(false, i % 10, -4 * (int)(i % 64) - 4));
+		CodeGen::push(MoveBlock(i % 9, Imm(i % 1000)));
+		CodeGen::push(AddBlock(3, 1, FlexSrc(2)));
+		CodeGen::push(SubBlock(4, 3, Imm(-(int)(i % 255))));
+		CodeGen::push(CMPBlock(4, Imm(17)));
+		CodeGen::push(MoveBlock(5, Imm(1), GT));
+		CodeGen::push(BranchBlock(l, LE));
+		CodeGen::push(StackOp(true, 4, -8));
+		CodeGen::push(LoadLabel(0, literal));
+		CodeGen::push(StackPushPop({0, 1}, true));
+		CodeGen::push(StackPushPop({0, 1}, false));
+		CodeGen::push(BBlock(printf, true));
+		i += 13;
+	}
+}
+
+//One instruction of every form emit prints
+static void sample()
+{
+	Label f = LabelAlloc::named("f");
+	Label l = LabelAlloc::allocate();
+	CodeGen::push(TextBlock(".section .rodata\n.literal_0:\n.asciz \"%d\"\n.text"));
+	CodeGen::push(GlobalBlock(f));
+	CodeGen::push(LabelBlock(f));
+	CodeGen::push(StackPushPop({4, 11, 14}, true));
+	CodeGen::push(MoveBlock(0, Imm(-5)));
+	CodeGen::push(MoveBlock(1, FlexSrc(2), GE));
+	CodeGen::push(ShiftedBlock(OP_MOV, 2, -1, 3, 2));
+	CodeGen::push(AddBlock(3, 1, FlexSrc(2)));
+	CodeGen::push(SubBlock(4, 3, Imm(255)));
+	CodeGen::push(RSBBlock(5, 4, Imm(0)));
+	CodeGen::push(AndBlock(6, 5, FlexSrc(4)));
+	CodeGen::push(OrBlock(7, 6, Imm(1)));
+	CodeGen::push(ShiftedBlock(OP_ADD, 8, 7, 6, 3));
+	CodeGen::push(CMPBlock(8, Imm(17)));
+	CodeGen::push(MulBlock(9, 1, 2));
+	CodeGen::push(MlaBlock(0, 1, 2, 3));
+	CodeGen::push(StackOp(true, 4, -8));
+	Instr load = StackOp(false, 5, 12);
+	load.rn = 13;
+	load.cond = NE;
+	CodeGen::push(load);
+	CodeGen::push(LoadLabel(0, LabelAlloc::literal(0)));
+	CodeGen::push(ConstBlock(1, -256));
+	CodeGen::push(ConstBlock(2, 100000));
+	CodeGen::push(LabelBlock(l));
+	CodeGen::push(BranchBlock(l, LE));
+	CodeGen::push(BBlock(LabelAlloc::named("printf"), true));
+	CodeGen::push(StackPushPop({4, 11, 15}, false));
+}
+
+static const char* const expected = R"(.section .rodata
+.literal_0:
+.asciz "%d"
+.text
+    .global f
+f:
+    STMFD sp!, {r4, r11, r14}
+    MOV r0, #-5
+    MOVGE r1, r2
+    MOV r2, r3, LSL #2
+    ADD r3, r1, r2
+    SUB r4, r3, #255
+    RSB r5, r4, #0
+    AND r6, r5, r4
+    ORR r7, r6, #1
+    ADD r8, r7, r6, LSL #3
+    CMP r8, #17
+    MUL r9, r1, r2
+    MLA r0, r1, r2, r3
+    STR r4, [fp, #-8]
+    LDRNE r5, [sp, #12]
+    LDR r0, =.literal_0
+    MVN r1, #255
+    LDR r2, =100000
+.L1:
+    BLE .L1
+    BL printf
+    LDMFD sp!, {r4, r11, r15}
+)";
+
+//The text emit prints for the current unit
+static std::string emitted()
+{
+	char tmpName[] = "/tmp/emitbenchXXXXXX";
+	int tmp = mkstemp(tmpName);
+	{
+		AsmWriter w(tmp);
+		CodeGen::emit(w);
+	}
+	std::ifstream readBack(tmpName);
+	std::stringstream text;
+	text << readBack.rdbuf();
+	close(tmp);
+	unlink(tmpName);
+	return text.str();
+}
+
+template<typename F>
+static double best(int reps, F f)
+{
+	double bestMs = 1e30;
+	for(int r=0; r<reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration<double, std::milli> d = std::chrono::steady_clock::now() - start;
+		if(d.count() < bestMs) bestMs = d.count();
+	}
+	return bestMs;
+}
+
+int main(int argc, char** argv)
+{
+	size_t n = argc > 1 ? atol(argv[1]) : 2000000;
+	int reps = argc > 2 ? atoi(argv[2]) : 5;
+
+	{
+		Compilation check;
+		Compilation::Scope useCheck(check);
+		sample();
+		std::string text = emitted();
+		if(text != expected){
+			std::cout << "Output of emit differs from the expected text:" << std::endl << text;
+			return 1;
+		}
+		std::ostringstream reference;
+		format(reference);
+		if(reference.str() != expected){
+			std::cout << "Output of format differs from the expected text:" << std::endl << reference.str();
+			return 1;
+		}
+	}
+
+	Compilation unit;
+	Compilation::Scope useUnit(unit);
+	fill(n);
+	size_t bytes = emitted().size();
+
+	double formatMs = best(reps, []{
+		std::ofstream out("/dev/null");
+		format(out);
+	});
+
+	double emitMs = best(reps, []{
+		int fd = open("/dev/null", O_WRONLY);
+		{
+			AsmWriter w(fd);
+			CodeGen::emit(w);
+		}
+		close(fd);
+	});
+
+	double mb = bytes / (1024.0 * 1024.0);
+	std::cout << n << " instructions, " << mb << " MiB of assembly, best of " << reps << std::endl;
+	std::cout << "format: " << formatMs << " ms (" << mb / (formatMs / 1000) << " MiB/s)" << std::endl;
+	std::cout << "emit:   " << emitMs << " ms (" << mb / (emitMs / 1000) << " MiB/s)" << std::endl;
+	std::cout << "speedup: " << formatMs / emitMs << "x" << std::endl;
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+Writes a synthetic C program in the subset ucc supports to stdout.
+
+usage: gencorpus [--functions N] [--stmts N] [--expr-depth N] [--nesting N]
+                 [--locals N] [--seed N]
+*/
+#include "Corpus.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	CorpusOptions opt;
+
+	for(int i=1; i<argc; i++){
+		int* knob = NULL;
+		if(strcmp(argv[i], "--functions") == 0) knob = &opt.functions;
+		else if(strcmp(argv[i], "--stmts") == 0) knob = &opt.stmts;
+		else if(strcmp(argv[i], "--expr-depth") == 0) knob = &opt.exprDepth;
+		else if(strcmp(argv[i], "--nesting") == 0) knob = &opt.nesting;
+		else if(strcmp(argv[i], "--locals") == 0) knob = &opt.locals;
+		else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc){
+			opt.seed = strtoul(argv[++i], NULL, 10);
+			continue;
+		}
+
+		if(knob == NULL || i+1 >= argc || atoi(argv[i+1]) < 0){
+			std::cerr << "usage: gencorpus [--functions N] [--stmts N] [--expr-depth N] [--nesting N] [--locals N] [--seed N]" << std::endl;
+			return 1;
+		}
+		*knob = atoi(argv[++i]);
+	}
+
+	CorpusGenerator gen(opt);
+	std::cout << gen.generate();
+	return 0;
+}
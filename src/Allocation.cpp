@@ -1,8 +1,15 @@
 #include "Tree.h"
 #include "Allocation.hpp"
+#include <algorithm>
 
-void RegAlloc::begin()
+bool RegAlloc::linearScan = false;
+
+void RegAlloc::begin(bool calls)
 {
+	state().calls = calls;
+	std::array<Registerable*, NREGS>& regs = state().regs;
+	int* lastUsed = state().lastUsed;
+	int& count = state().count;
 	count = 0;
 	for(int i=0; i<NREGS; i++)
 	{
@@ -11,15 +18,38 @@ void RegAlloc::begin()
 	}
 }
 
-int RegAlloc::getEmptyReg()
+//Kept in a register by the innermost loop
+static bool pinned(const std::vector<RegAlloc::Loop>& loops, Registerable* v)
 {
-	int oldest=0;
-	for(int i=0; i<NREGS; i++)
+	if(loops.empty()) return false;
+	const RegAlloc::Layout& header = loops.back().header;
+	return std::find(header.begin(), header.end(), v) != header.end();
+}
+
+/*
+A free register, or else the least recently used one after storing its
+value. Values the innermost loop keeps are only evicted when nothing else
+is left. A lasting value looks from r4 up first, where calls leave it.
+*/
+int RegAlloc::getEmptyReg(bool lasting)
+{
+	std::array<Registerable*, NREGS>& regs = state().regs;
+	int* lastUsed = state().lastUsed;
+	int& count = state().count;
+	int oldest=-1;
+	int oldestPinned=-1;
+	for(int n=0; n<NREGS; n++)
 	{
-		if(regs[i] == NULL) return i;
+		int i = lasting ? (n + CALLER_SAVED) % NREGS : n;
+		if(regs[i] == NULL){
+			lastUsed[i] = ++count;
+			return i;
+		}
 
-		if(lastUsed[i] < lastUsed[oldest]) oldest = i;
+		int& best = pinned(state().loops, regs[i]) ? oldestPinned : oldest;
+		if(best < 0 || lastUsed[i] < lastUsed[best]) best = i;
 	}
+	if(oldest < 0) oldest = oldestPinned;
 	if(regs[oldest]!=NULL)regs[oldest]->store();
 	
 	regs[oldest]=NULL;
@@ -33,43 +63,82 @@ int RegAlloc::getEmptyReg()
 
 void RegAlloc::bindReg(Registerable* s)
 {
+	std::array<Registerable*, NREGS>& regs = state().regs;
+	auto& stack = state().stack;
 	for(size_t i=0; i<stack.size(); i++)
 	{
 		stack[i].second.insert(s);
 	}
 	
-	if(s->inReg) return;
-	int r = getEmptyReg();
+	if(s->inReg){
+		if(!linearScan) state().lastUsed[s->regLoc] = ++state().count;
+		return;
+	}
+	if(linearScan){
+		s->use(newVirtual());
+		return;
+	}
+	//Without calls nothing needs r4 and up, which the function would have to save
+	int r = getEmptyReg(state().calls && s->outlivesCalls());
 	s->use(r);
 	regs[r] = s;
 }
 
 void RegAlloc::bindReg(Registerable* s, int r)
 {
+	std::array<Registerable*, NREGS>& regs = state().regs;
+	auto& stack = state().stack;
 	for(size_t i=0; i<stack.size(); i++)
 	{
 		stack[i].second.insert(s);
 	}
 	
+	//A value arriving in r, such as a parameter or a call result
+	if(linearScan){
+		if(!s->inReg) s->use(newVirtual());
+		CodeGen::push(MoveBlock(s->regLoc, r));
+		return;
+	}
+
 	if(s->inReg && s->regLoc == r) return;
 	
 	if(regs[r] != NULL)
 		regs[r]->store();
 		
 	if(s->inReg)
-		CodeGen::push(new MoveBlock(r, s->regLoc));
+		CodeGen::push(MoveBlock(r, s->regLoc));
 	else
 		s->use(r);
 	
 	regs[r] = s;
 }
 
+/*
+The value's stack slot is where it was passed, which Frame finds past what
+the prologue pushes, so it is loaded from there when it is first used
+*/
+void RegAlloc::bindStacked(Registerable* s, int offset)
+{
+	if(linearScan){
+		s->use(newVirtual());
+		CodeGen::push(StackOp(false, s->regLoc, offset));
+		return;
+	}
+	s->stackLocation = offset;
+	s->stackAllocated = true;
+	s->used = true;
+}
+
 // Free up a register
 void RegAlloc::freeReg(int r){
+	if(r >= FIRST_VIRTUAL) return;
+	std::array<Registerable*, NREGS>& regs = state().regs;
 	regs[r] = NULL;
 }
 
 void RegAlloc::swap(int a, int b){
+	std::array<Registerable*, NREGS>& regs = state().regs;
+	int* lastUsed = state().lastUsed;
 	Registerable* one = regs[a];
 	if(one)one->use(b);
 	Registerable* two = regs[b];
@@ -83,6 +152,7 @@ void RegAlloc::swap(int a, int b){
 
 void RegAlloc::print()
 {
+	std::array<Registerable*, NREGS>& regs = state().regs;
 	for(int i=0; i<NREGS; i++)
 	{
 		std::cout << i;
@@ -98,6 +168,7 @@ Restore the internal state of the registers to the provided snapshot.
 This function will not generate code to store/load stack state.
 */
 void RegAlloc::restoreSnapshot(std::array<Registerable*, NREGS> snap){
+	std::array<Registerable*, NREGS>& regs = state().regs;
 	for(int i=0; i<NREGS; i++){
 		if(regs[i] != nullptr){
 			regs[i]->restore();
@@ -112,6 +183,186 @@ void RegAlloc::restoreSnapshot(std::array<Registerable*, NREGS> snap){
 	}
 }
 
+/*
+The layout two paths agree on: values in the same register in both keep it,
+and a value that is in different registers is kept in b's, which costs one
+move on the way from a.
+*/
+RegAlloc::Layout RegAlloc::joinLayout(const Layout& a, const Layout& b)
+{
+	Layout joined{};
+	for(int i=0; i<NREGS; i++){
+		if(a[i] != NULL && a[i] == b[i]) joined[i] = a[i];
+	}
+	for(int i=0; i<NREGS; i++){
+		if(b[i] == NULL || joined[i] != NULL) continue;
+		for(int j=0; j<NREGS; j++){
+			if(a[j] == b[i]) joined[i] = b[i];
+		}
+	}
+	return joined;
+}
+
+/*
+Generates the least code that takes the registers from their current state
+to target: values the target doesn't keep are stored, values in the wrong
+register are moved and values the target keeps but that are on the stack
+are loaded.
+*/
+void RegAlloc::reconcile(const Layout& target)
+{
+	Layout& regs = state().regs;
+	int* lastUsed = state().lastUsed;
+
+	for(int i=0; i<NREGS; i++){
+		if(regs[i] == NULL) continue;
+		bool kept = false;
+		for(int j=0; j<NREGS; j++) kept |= target[j] == regs[i];
+		if(!kept) store(i);
+	}
+
+	bool blocked = true;
+	while(blocked){
+		blocked = false;
+		bool moved = false;
+		for(int i=0; i<NREGS; i++){
+			Registerable* v = target[i];
+			if(v == NULL || regs[i] == v || !v->inReg) continue;
+			if(regs[i] != NULL){
+				blocked = true;
+				continue;
+			}
+			int from = v->regLoc;
+			CodeGen::push(MoveBlock(i, from));
+			regs[from] = NULL;
+			regs[i] = v;
+			lastUsed[i] = lastUsed[from];
+			v->regLoc = i;
+			moved = true;
+		}
+
+		//Moves that wait on each other; storing one lets the rest go
+		if(blocked && !moved){
+			for(int i=0; i<NREGS; i++){
+				Registerable* v = target[i];
+				if(v != NULL && regs[i] != NULL && regs[i] != v && v->inReg){
+					store(i);
+					break;
+				}
+			}
+		}
+	}
+
+	for(int i=0; i<NREGS; i++){
+		Registerable* v = target[i];
+		if(v == NULL || regs[i] == v) continue;
+		v->use(i);
+		regs[i] = v;
+	}
+}
+
+/*
+Keeps the variables a loop refers to in registers from one iteration to the
+next. The most referenced ones, then values enclosing loops keep, make up
+the header layout: it is reached before the loop is entered and again on
+every edge back to the top, so nothing is stored or loaded around the back
+edge unless the body leaves a variable somewhere else.
+*/
+void RegAlloc::beginLoop(const LoopVariables& vars)
+{
+	State& st = state();
+	st.loops.push_back(Loop());
+	Loop& loop = st.loops.back();
+	loop.header = Layout{};
+	loop.exit = Layout{};
+	loop.local.assign(vars.declared.begin(), vars.declared.end());
+	std::sort(loop.local.begin(), loop.local.end());
+	if(linearScan) return;
+
+	//References of each variable that lives across iterations, in order of first reference
+	std::vector<std::pair<int, Registerable*> > ranked;
+	std::map<Registerable*, size_t> rank;
+	for(size_t i=0; i<vars.used.size(); i++){
+		Registerable* v = vars.used[i];
+		if(std::binary_search(loop.local.begin(), loop.local.end(), v)) continue;
+		auto it = rank.find(v);
+		if(it == rank.end()){
+			rank[v] = ranked.size();
+			ranked.push_back(std::make_pair(1, v));
+		}
+		else ranked[it->second].first++;
+	}
+	std::stable_sort(ranked.begin(), ranked.end(),
+		[](const std::pair<int, Registerable*>& a, const std::pair<int, Registerable*>& b){return a.first > b.first;});
+	if(st.loops.size() > 1){
+		const Layout& outer = st.loops[st.loops.size() - 2].header;
+		for(int i=0; i<NREGS; i++){
+			if(outer[i] != NULL && outer[i]->inReg && rank.find(outer[i]) == rank.end()){
+				ranked.push_back(std::make_pair(0, outer[i]));
+			}
+		}
+	}
+	if(ranked.size() > (size_t)LOOP_PINNED) ranked.resize(LOOP_PINNED);
+
+	//Values already in a register stay there
+	Layout& header = loop.header;
+	std::vector<Registerable*> placing;
+	for(size_t i=0; i<ranked.size(); i++){
+		Registerable* v = ranked[i].second;
+		if(v->inReg) header[v->regLoc] = v;
+		else placing.push_back(v);
+	}
+	//From r4 up, which calls in the loop leave alone, if there are any
+	int r = state().calls ? CALLER_SAVED : 0;
+	for(size_t i=0; i<placing.size(); i++){
+		while(header[r % NREGS] != NULL) r++;
+		header[r % NREGS] = placing[i];
+	}
+
+	reconcile(header);
+}
+
+void RegAlloc::markLoopExit()
+{
+	state().loops.back().exit = createSnapshot();
+}
+
+//Variables declared in the loop's body don't need storing when an iteration ends
+static void dropLocals(RegAlloc::Layout& regs, const RegAlloc::Loop& loop)
+{
+	for(int i=0; i<NREGS; i++){
+		if(regs[i] != NULL && std::binary_search(loop.local.begin(), loop.local.end(), regs[i])){
+			regs[i]->restore();
+			regs[i] = NULL;
+		}
+	}
+}
+
+void RegAlloc::toLoopHeader()
+{
+	State& st = state();
+	assert(!st.loops.empty());
+	dropLocals(st.regs, st.loops.back());
+	reconcile(st.loops.back().header);
+}
+
+void RegAlloc::toLoopExit()
+{
+	State& st = state();
+	assert(!st.loops.empty());
+	dropLocals(st.regs, st.loops.back());
+	reconcile(st.loops.back().exit);
+}
+
+//Code after the loop starts from the registers at its exit
+void RegAlloc::endLoop()
+{
+	State& st = state();
+	Layout exit = st.loops.back().exit;
+	st.loops.pop_back();
+	restoreSnapshot(exit);
+}
+
 /*
 void RegAlloc::pushState()
 {
@@ -157,6 +408,7 @@ void RegAlloc::popState(Branch* loop)
 }
 */
 void RegAlloc::store(int i){
+	std::array<Registerable*, NREGS>& regs = state().regs;
 	if(regs[i]!=NULL){
 		regs[i]->store();
 		regs[i] = NULL;
@@ -171,52 +423,107 @@ void RegAlloc::storeAll(int from)
 	}
 }
 
+void RegAlloc::storeCallerSaved()
+{
+	for(int i=0; i<CALLER_SAVED; i++) store(i);
+}
+
+/*
+Temporaries die with the call, so they are moved where they are passed and
+forgotten; anything else is copied there and stays where it is, moved out of
+the way if it was in one of the registers.
+*/
+void RegAlloc::placeArguments(const std::vector<Registerable*>& values)
+{
+	int n = values.size();
+	if(linearScan){
+		for(int i=0; i<n; i++){
+			if(values[i]) CodeGen::push(MoveBlock(i, values[i]->bind()));
+		}
+		return;
+	}
+
+	Layout& regs = state().regs;
+	Layout target = regs;
+	for(int i=0; i<n; i++){
+		Registerable* v = values[i];
+		if(v == NULL || v->outlivesCalls()) continue;
+		std::replace(target.begin(), target.end(), v, (Registerable*)NULL);
+	}
+	for(int i=0; i<n; i++){
+		Registerable* in = target[i];
+		if(in == NULL) continue;
+		target[i] = NULL;
+		//Where the call leaves it if there is room, otherwise it is stored
+		int r = std::max(n, CALLER_SAVED);
+		while(r < NREGS && target[r] != NULL) r++;
+		if(r == NREGS){
+			r = n;
+			while(r < CALLER_SAVED && target[r] != NULL) r++;
+		}
+		if(r < NREGS && target[r] == NULL) target[r] = in;
+	}
+	for(int i=0; i<n; i++){
+		if(values[i] && !values[i]->outlivesCalls()) target[i] = values[i];
+	}
+	reconcile(target);
+
+	for(int i=0; i<n; i++){
+		Registerable* v = values[i];
+		if(v == NULL) continue;
+		if(!v->outlivesCalls()){
+			v->restore();
+			regs[i] = NULL;
+		}
+		else if(v->inReg) CodeGen::push(MoveBlock(i, v->regLoc));
+		else if(v->used){
+			Stats::count(COUNT_RELOADS);
+			CodeGen::push(StackOp(false, i, v->getStackLocation()));
+		}
+	}
+}
+
 void RegAlloc::loadAll(int from)
 {
+	std::array<Registerable*, NREGS>& regs = state().regs;
 	for(int i=from; i<NREGS; i++)
 	{
 		if(regs[i]!=NULL)regs[i]->use(i);
 	}
 }
 
-std::string StringBin::intToLabel(int label){
-	std::string stLabel = ".literal_" + std::to_string((long long) label);
-	return stLabel;
+Label StringBin::newLiteral(std::string text)
+{
+	return intern(text.substr(1,text.length()-2));
 }
 
-std::string StringBin::newLiteral(std::string text)
+Label StringBin::intern(const std::string& text)
 {
-	text = text.substr(1,text.length()-2);
+	std::map<std::string, int>& stringMap = state().stringMap;
 
-	decltype(stringMap)::iterator it;
-	if ((it = stringMap.find(text)) == StringBin::stringMap.end()){
-		int index = StringBin::stringMap.size();
+	std::map<std::string, int>::iterator it;
+	if ((it = stringMap.find(text)) == stringMap.end()){
+		int index = stringMap.size();
 		stringMap[text] = index;
 	}
 
 	int index = stringMap[text];
 	
-	return intToLabel(index);
+	return LabelAlloc::literal(index);
 }
 
-TextBlock* StringBin::createDirectives(){
-
+Instr StringBin::createDirectives(){
+	std::map<std::string, int>& stringMap = state().stringMap;
 	std::string header = ".section .rodata\n";
 	for (auto it = stringMap.begin(); it != stringMap.end(); it++)
 	{
 		int index = it->second;
-		std::string stLabel = intToLabel(index);
+		std::string stLabel = LabelAlloc::name(LabelAlloc::literal(index));
 		std::string text = it->first;
 		std::string code = stLabel + ":\n.asciz \"" + text + "\"\n";
 		header += code;
 	}
 	header += ".text\n";
 
-	return new TextBlock(header);
+	return TextBlock(header);
 }
-
-decltype(RegAlloc::stack) RegAlloc::stack;
-decltype(RegAlloc::regs) RegAlloc::regs;
-int RegAlloc::lastUsed[NREGS];
-int RegAlloc::count;
-std::map<std::string, int> StringBin::stringMap;
\ No newline at end of file
@@ -10,33 +10,37 @@
 #include <map>
 
 #define NREGS 10
+#define FIRST_VIRTUAL 16
+#define LOOP_PINNED (NREGS - 4)	//Most variables a loop keeps in registers, the rest are left for expressions
+#define CALLER_SAVED 4	//r0-r3 are overwritten by calls, every function keeps r4 and up for its caller
 
 /*
 0 - 9 general use
-10 - 11 not used
+10 not used
+11	frame pointer, or general use given out by LinearScan where there is none
 12	scrtch
 13	stack pointer
 14	link reg
 15	pc
+16 -	virtual, given physical registers by LinearScan
 */
 
 /* Function call:
 First 4 words are passed via r0-3
 Anything extra must be passed by stack
 Return value through r0
+r4-r11 are saved by the callee if it uses them, see Frame
 */
 
+//Stack slots below fp, which Frame makes room for once the function is done
 class StackScope
 {
 	int framePos;
 	int allocAmt;
-	SubBlock* incStack;
 public:
 	
 	StackScope(int framePos){
 		allocAmt = 4;
-		incStack = new SubBlock(13,13,Imm(0));
-		CodeGen::push(incStack);
 	}
 
 	int allocate(int size)
@@ -47,10 +51,10 @@ public:
 		return -ret;
 	}
 
-	~StackScope(){
-		Imm immValue(allocAmt);
-		incStack->setOp2(immValue);
-		CodeGen::push(new AddBlock(13,13,immValue));
+	//Bytes taken by the slots
+	int size()
+	{
+		return allocAmt - 4;
 	}
 	
 	int getEnd()
@@ -63,11 +67,18 @@ public:
 
 class StackStore
 {
-	static std::vector<StackScope*> scopes;
+	public:
+	struct State
+	{
+		std::vector<StackScope*> scopes;
+	};
+	
+	private:
+	static State& state();
 	
 	public:
 	static void beginFunc(){
-		scopes.push_back(new StackScope(0));
+		state().scopes.push_back(new StackScope(0));
 	}
 	
 	static void begin(){
@@ -76,7 +87,7 @@ class StackStore
 	
 	static int allocate(int size)
 	{
-		return scopes.back()->allocate(size);
+		return state().scopes.back()->allocate(size);
 	}
 	
 	static void end(){
@@ -85,11 +96,15 @@ class StackStore
 		assert(scopes.size() != 0);*/
 	}
 	
-	static void endFunc(){
+	//Returns the size of the function's stack slots
+	static int endFunc(){
+		std::vector<StackScope*>& scopes = state().scopes;
+		int size = scopes.back()->size();
 		delete scopes.back();
 		scopes.pop_back();
 		
 		assert(scopes.size() == 0);
+		return size;
 	}
 	
 
@@ -97,35 +112,79 @@ class StackStore
 
 class Registerable;
 class Branch;
+struct LoopVariables;
 class RegAlloc
 {
-	static std::vector<std::pair<std::array<Registerable*, NREGS>, std::set<Registerable*> > > stack;
+	public:
+	typedef std::array<Registerable*, NREGS> Layout;
+
+	struct Loop
+	{
+		Layout header;	//Registers at the top of every iteration
+		Layout exit;	//Registers where the loop is left
+		std::vector<Registerable*> local;	//Declared in the body, so dead when an iteration ends; sorted
+	};
+
+	struct State
+	{
+		std::vector<std::pair<std::array<Registerable*, NREGS>, std::set<Registerable*> > > stack;
+		std::array<Registerable*, NREGS> regs{};
+		int lastUsed[NREGS] = {};
+		int count = 0;
+		int nextVirtual = FIRST_VIRTUAL;
+		bool calls = false;	//Whether the function being generated makes calls
+		std::vector<Loop> loops;	//Loops being generated, innermost last
+	};
+	
+	private:
 	friend class CodeGen;
-	protected:
-	static std::array<Registerable*, NREGS> regs;
-	static int lastUsed[NREGS];
-	static int count;
+	static State& state();
 	
 	public:
+	//With --regalloc=linear every value gets a virtual register of its own
+	//and nothing is stored here; LinearScan allocates each function after it
+	static bool linearScan;
+
+	static int newVirtual(){return state().nextVirtual++;}
+
 	static void swap(int,int);
-	static void begin();
-	static int getEmptyReg();
+	static void begin(bool calls = false);
+	static int getEmptyReg(bool lasting = false);	//Trying r4 and up first if lasting
 	static void bindReg(Registerable* s, int r);
 	static void bindReg(Registerable* s);
+	//A value passed on the stack, offset bytes above sp at the call
+	static void bindStacked(Registerable* s, int offset);
 	static void freeReg(int i);
 	static int getScratch(){return 12;}
 
 	static void print();
 
-	static std::array<Registerable*, NREGS> createSnapshot(){
-		return regs;
+	static Layout createSnapshot(){
+		return state().regs;
 	}
 	static void restoreSnapshot(std::array<Registerable*, NREGS>);
+
+	//Layout for where two paths meet, and the code to get to it from this one
+	static Layout joinLayout(const Layout& a, const Layout& b);
+	static void reconcile(const Layout& target);
 	static void pushState();
 	static void popState(Branch*);
 
+	//Loops: beginLoop before the top label, markLoopExit at the exit branch,
+	//toLoopHeader and toLoopExit before each jump back or out, endLoop after the back edge
+	static void beginLoop(const LoopVariables& vars);
+	static void markLoopExit();
+	static void toLoopHeader();
+	static void toLoopExit();
+	static void endLoop();
+
 	static void store(int);
 	static void storeAll(int = 0);
+	static void storeCallerSaved();	//Before a call, which overwrites r0-r3
+
+	//Puts values in r0 up for a call or for pushing its stack arguments,
+	//clearing the registers of NULL ones for the caller to fill
+	static void placeArguments(const std::vector<Registerable*>& values);
 	static void loadAll(int = 0);
 
 };
@@ -133,11 +192,19 @@ class RegAlloc
 
 class StringBin
 {
-	static std::map<std::string, int> stringMap;
-	static std::string intToLabel(int);
 public:
-	static std::string newLiteral(std::string);
-	static TextBlock* createDirectives();
+	struct State
+	{
+		std::map<std::string, int> stringMap;
+	};
+
+private:
+	static State& state();
+
+public:
+	static Label newLiteral(std::string);
+	static Label intern(const std::string& text);	//text without its quotes
+	static Instr createDirectives();
 
 	
 };
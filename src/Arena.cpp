@@ -0,0 +1,36 @@
+#include "Arena.hpp"
+
+thread_local Arena* Arena::active = NULL;
+
+void* Arena::allocateSlow(size_t size)
+{
+	//Large requests get a block of their own so the current one isn't wasted
+	if(size > BLOCK_SIZE / 4){
+		char* block = static_cast<char*>(::operator new(size));
+		blocks.push_back(block);
+		reserved += size;
+		return block;
+	}
+
+	char* block = static_cast<char*>(::operator new(BLOCK_SIZE));
+	blocks.push_back(block);
+	reserved += BLOCK_SIZE;
+	pos = block + size;
+	end = block + BLOCK_SIZE;
+	return block;
+}
+
+Arena::~Arena()
+{
+	Scope scope(*this);
+
+	//Destroy in reverse order of creation
+	for(size_t i = live.size(); i-- > 0;){
+		if(live[i] != NULL) live[i]->~ArenaObject();
+	}
+	live.clear();
+
+	for(size_t i=0; i<blocks.size(); i++){
+		::operator delete(blocks[i]);
+	}
+}
@@ -0,0 +1,135 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+class ArenaObject;
+
+/*
+Bump allocator for everything created while compiling one translation unit:
+AST branches and scoped variables/functions.
+Memory is handed out from large blocks and returned in one go when the arena
+is destroyed, after the destructors of all objects still alive have been run.
+*/
+class Arena
+{
+	static const size_t BLOCK_SIZE = 64 * 1024;
+	static const size_t ALIGN = alignof(std::max_align_t);
+
+	static thread_local Arena* active;	//Per thread, so units can be compiled in parallel
+
+	std::vector<char*> blocks;
+	std::vector<ArenaObject*> live;	//Objects whose destructor has not run yet
+	char* pos;
+	char* end;
+	size_t reserved;
+
+	void* allocateSlow(size_t size);
+
+public:
+	Arena():
+		pos(NULL), end(NULL), reserved(0)
+	{}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	~Arena();
+
+	void* allocate(size_t size)
+	{
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		if((size_t)(end - pos) < size) return allocateSlow(size);
+
+		void* ret = pos;
+		pos += size;
+		return ret;
+	}
+
+	unsigned track(ArenaObject* o)
+	{
+		live.push_back(o);
+		return live.size() - 1;
+	}
+
+	void untrack(unsigned slot)
+	{
+		if(slot < live.size()) live[slot] = NULL;
+	}
+
+	size_t bytesReserved() const
+	{
+		return reserved;
+	}
+
+	//Objects allocated here, NULL where one has been destroyed
+	const std::vector<ArenaObject*>& liveObjects() const
+	{
+		return live;
+	}
+
+	static Arena* current()
+	{
+		return active;
+	}
+
+	/*
+	Makes an arena the target of arena object allocations for the lifetime
+	of the Scope, restoring the previous one afterwards
+	*/
+	class Scope
+	{
+		Arena* previous;
+	public:
+		Scope(Arena& a):
+			previous(active)
+		{
+			active = &a;
+		}
+		~Scope()
+		{
+			active = previous;
+		}
+	};
+};
+
+/*
+Base class for objects allocated with new inside the current Arena.
+delete runs the destructor but leaves the memory to the arena.
+*/
+class ArenaObject
+{
+	unsigned arenaSlot;
+
+public:
+	static void* operator new(size_t size)
+	{
+		return Arena::current()->allocate(size);
+	}
+
+	static void operator delete(void*)
+	{}
+
+	ArenaObject()
+	{
+		arenaSlot = Arena::current()->track(this);
+	}
+
+	ArenaObject(const ArenaObject&)
+	{
+		arenaSlot = Arena::current()->track(this);
+	}
+
+	ArenaObject& operator=(const ArenaObject&)
+	{
+		return *this;
+	}
+
+	virtual ~ArenaObject()
+	{
+		Arena::current()->untrack(arenaSlot);
+	}
+};
+
+#endif
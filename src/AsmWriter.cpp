@@ -0,0 +1,33 @@
+#include "AsmWriter.hpp"
+#include <unistd.h>
+#include <cerrno>
+
+AsmWriter::AsmWriter(int f):
+	fd(f), buf(new char[BUFFER_SIZE]), len(0), failed(false)
+{}
+
+AsmWriter::~AsmWriter()
+{
+	flush();
+	delete[] buf;
+}
+
+void AsmWriter::flush()
+{
+	writeAll(buf, len);
+	len = 0;
+}
+
+void AsmWriter::writeAll(const char* s, size_t n)
+{
+	while(n > 0 && !failed){
+		ssize_t w = write(fd, s, n);
+		if(w < 0){
+			if(errno == EINTR) continue;
+			failed = true;
+			return;
+		}
+		s += w;
+		n -= w;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef ASMWRITER_H
+#define ASMWRITER_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+/*
+Output buffer for generated assembly. Text is appended straight into one
+reusable buffer and handed to the OS with large write() calls, so emitting an
+instruction never allocates.
+*/
+class AsmWriter
+{
+	static const size_t BUFFER_SIZE = 256 * 1024;
+
+	int fd;
+	char* buf;
+	size_t len;
+	bool failed;
+
+public:
+	AsmWriter(int fd);
+	~AsmWriter();
+
+	AsmWriter(const AsmWriter&) = delete;
+	AsmWriter& operator=(const AsmWriter&) = delete;
+
+	void put(const char* s, size_t n)
+	{
+		if(len + n > BUFFER_SIZE){
+			flush();
+			if(n > BUFFER_SIZE){
+				writeAll(s, n);
+				return;
+			}
+		}
+		memcpy(buf + len, s, n);
+		len += n;
+	}
+
+	void put(const std::string& s)
+	{
+		put(s.data(), s.size());
+	}
+
+	template<size_t N>
+	void put(const char (&s)[N])
+	{
+		put(s, N - 1);
+	}
+
+	void put(char c)
+	{
+		if(len == BUFFER_SIZE) flush();
+		buf[len++] = c;
+	}
+
+	void putInt(int v)
+	{
+		char digits[12];
+		char* p = digits + sizeof(digits);
+		unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+		do{
+			*--p = '0' + u % 10;
+			u /= 10;
+		}while(u != 0);
+		if(v < 0) *--p = '-';
+		put(p, digits + sizeof(digits) - p);
+	}
+
+	void flush();
+	void writeAll(const char* s, size_t n);
+
+	//False if any write to the descriptor failed
+	bool good() const
+	{
+		return !failed;
+	}
+};
+
+#endif
@@ -16,4 +16,95 @@ void orderResult(ExpressionResult& exp1, ExpressionResult& exp2, ResultLocation
 	std::swap(exp1, exp2);
 }
 
-TranslationUnit* TopBranch::tu;
+/*
+Folded when both are constants, shifts and adds for a constant that takes
+few enough of them, and MUL otherwise
+*/
+ExpressionResult multiply(ExpressionResult lhs, ExpressionResult rhs)
+{
+	if(checkResult(lhs, rhs, CONST, CONST)){
+		return std::make_shared<ConstResult>((int32_t)((uint32_t)lhs->getValue() * (uint32_t)rhs->getValue()));
+	}
+
+	if(checkResult(lhs, rhs, REG, CONST)){
+		orderResult(lhs, rhs, REG);
+		int32_t c = rhs->getValue();
+		if(c == 0) return std::make_shared<ConstResult>(0);
+		if(Multiply::reducible(c)){
+			auto tempval = TemporaryValue::create();
+			int res = tempval->getReg();
+			Multiply::byConstant(res, Src(lhs->toRegisterable()).value, c);
+			return std::make_shared<TempResult>(tempval);
+		}
+	}
+
+	auto tempval = TemporaryValue::create();
+	int res = tempval->getReg();
+	CodeGen::push(MulBlock(res, lhs->toRegisterable(), rhs->toRegisterable()));
+	return std::make_shared<TempResult>(tempval);
+}
+
+//Marks the argument of an enclosing call this is part of, if any
+void FunctionCall::resolve()
+{
+	if(ael) ael->resolve();
+	for(Branch* b = parent; b != NULL; b = b->getParent()){
+		FuncDef* f = dynamic_cast<FuncDef*>(b);
+		if(f){
+			f->markCalls();
+			break;
+		}
+	}
+	for(Branch* b = parent; b != NULL && !dynamic_cast<_Statement*>(b); b = b->getParent()){
+		ArgumentExpressionList* arg = dynamic_cast<ArgumentExpressionList*>(b);
+		if(arg){
+			arg->markCalls();
+			return;
+		}
+	}
+}
+
+void FunctionCall::pass(std::vector<ExpressionResult>& args, size_t from, size_t to)
+{
+	std::vector<Registerable*> values;
+	for(size_t i=from; i<to; i++){
+		values.push_back(args[i]->loc == REG ? args[i]->getRegisterable() : NULL);
+	}
+	RegAlloc::placeArguments(values);
+
+	for(size_t i=from; i<to; i++){
+		int r = i - from;
+		if(args[i]->loc == CONST) CodeGen::push(ConstBlock(r, args[i]->getValue()));
+		else if(args[i]->loc == LITERAL) CodeGen::push(LoadLabel(r, std::static_pointer_cast<LiteralResult>(args[i])->getLabel()));
+	}
+}
+
+int FunctionCall::lower(IrBuilder& ir)
+{
+	std::vector<int> args;
+	if(ael) ael->lower(ir, args);
+
+	auto found = Compilation::current().functions.find(iden->symbol());
+	int size;
+	if(found != Compilation::current().functions.end()){
+		FuncDef* callee = found->second;
+		if(callee->inlinable(args.size(), size) && ir.inlines(callee, size, callee->isInline(), args)){
+			return callee->lowerInline(ir, args);
+		}
+	}
+
+	return ir.add(IR_CALL, IR_INT, args, iden->symbol());
+}
+
+bool FunctionCall::lowerRecursion(IrBuilder& ir)
+{
+	auto found = Compilation::current().functions.find(iden->symbol());
+	if(found == Compilation::current().functions.end() || !ir.recurses(found->second)) return false;
+	FuncDef* callee = found->second;
+	if(callee->parameters() != (size_t)(ael ? ael->size() : 0)) return false;
+
+	std::vector<int> args;
+	if(ael) ael->lower(ir, args);
+	callee->lowerRecursion(ir, args);
+	return true;
+}
@@ -12,6 +12,15 @@
 #include "LabelAlloc.hpp"
 #include <memory>
 #include "ExpressionResultTypes.hpp"
+#include "Compilation.hpp"
+#include "ThreadPool.hpp"
+#include "LinearScan.hpp"
+#include "Peephole.hpp"
+#include "IrBuilder.hpp"
+#include "InstrSelect.hpp"
+#include "Multiply.hpp"
+#include "Frame.hpp"
+#include "KnownValues.hpp"
 
 
 
@@ -128,11 +137,14 @@ class ExpressionResult
 
 template <typename T>
 T* fit(ExpressionResult& exp1){
-	auto r = dynamic_cast<T*>(exp1.get());
+	return dynamic_cast<T*>(exp1.get());
 }
 bool checkResult(ExpressionResult& exp1, ResultLocation l1);
 bool checkResult(ExpressionResult& exp1, ExpressionResult& exp2, ResultLocation l1, ResultLocation l2);
 void orderResult(ExpressionResult& exp1, ExpressionResult& exp2, ResultLocation l1);
+ExpressionResult multiply(ExpressionResult lhs, ExpressionResult rhs);
+
+class FunctionCall;
 
 class _Expression: public Branch
 {
@@ -143,6 +155,28 @@ public:
 
 	virtual ExpressionResult execute() = 0;
 	//Generates code for and returns a result
+
+	//Adds the expression to the function's IR and returns its value; one
+	//without a lowering keeps the whole function out of the IR
+	virtual int lower(IrBuilder&){
+		throw UnimplementedException("no IR for expression");
+	}
+
+	//The variable assigning to this expression writes, if it is one
+	virtual ScopedVariable* variable(){
+		return NULL;
+	}
+
+	//Whether this is a multiplication, in which case its operands are
+	//generated into a and b for the caller to multiply and accumulate
+	virtual bool factors(ExpressionResult&, ExpressionResult&){
+		return false;
+	}
+
+	//The call this expression is, if it is one
+	virtual FunctionCall* call(){
+		return NULL;
+	}
 };
 
 class AssignmentExpression: public _Expression
@@ -175,10 +209,40 @@ public:
 		return unaryexp->format() + " " + op->format() + " " + assignmentexp->format();
 	}
 
+	void resolve()
+	{
+		if(mode == 0){
+			conditionalexp->resolve();
+			return;
+		}
+		unaryexp->resolve();
+		assignmentexp->resolve();
+		ScopedVariable* var = unaryexp->variable();
+		if(var) ScopeTable::write(var);
+	}
+
+	int lower(IrBuilder& ir)
+	{
+		if(mode==0) return conditionalexp->lower(ir);
+		ScopedVariable* var = unaryexp->variable();
+		if(var == NULL || op->getType() != '=') return _Expression::lower(ir);
+		int value = assignmentexp->lower(ir);
+		ir.write(var, value);
+		return value;
+	}
+
+	//A constant assigned to a variable is known from here on, see KnownValues
 	ExpressionResult execute()
 	{
 		if(mode==0) return conditionalexp->execute();
-		ExpressionResult lhs = unaryexp->execute();
+		ScopedVariable* var = unaryexp->variable();
+		ExpressionResult lhs;
+		if(var){
+			//The variable itself rather than a value it is known to have
+			RegAlloc::bindReg(var);
+			lhs = std::make_shared<VarResult>(var);
+		}
+		else lhs = unaryexp->execute();
 		ExpressionResult rhs = assignmentexp->execute();
 
 		if (!checkResult(lhs, REG)) throw SyntaxError("Left hand size of assignment is immutable");
@@ -186,19 +250,22 @@ public:
 		if(rhs->loc == LITERAL) rhs = rhs->toRegisterable();
 
 		if(checkResult(rhs, REG)){
-			CodeGen::push(new MoveBlock(lhs, rhs));
+			CodeGen::push(MoveBlock(lhs, rhs));
 		}
 		else if(checkResult(rhs, CONST)){
-			CodeGen::push(new MoveBlock(lhs, rhs));
+			CodeGen::push(ConstBlock(lhs, rhs->getValue()));
 		}
 		else
 		{
 			FlagsResult* flagResult = fit<FlagsResult>(rhs);
-			CodeGen::push(new MoveBlock(lhs, Imm(0)));
-			CodeGen::push(new MoveBlock(lhs, Imm(1), flagResult->getFlag()));
+			CodeGen::push(MoveBlock(lhs, Imm(0)));
+			CodeGen::push(MoveBlock(lhs, Imm(1), flagResult->getFlag()));
 		}
 
-		return lhs;
+		bool known = checkResult(rhs, CONST) && op->getType() == '=';
+		if(var && known) KnownValues::set(var, rhs->getValue());
+		else if(var) KnownValues::forget(var);
+		return known ? rhs : lhs;
 	}
 	
 };
@@ -206,21 +273,53 @@ public:
 
 class Identifier: public _Expression
 {
-	std::string id;
+	SymbolId id;
+	ScopedVariable* var;	//Set by resolve
 public:
-	Identifier(std::string s){
+	Identifier(SymbolId s){
 		id = s;
+		var = NULL;
+	}
+	Identifier(ScopedVariable* v){
+		id = v->symbol();
+		var = v;
 	}
 	std::string format(){
+		return SymbolTable::name(id);
+	}
+	SymbolId symbol(){
 		return id;
 	}
 
+	void resolve()
+	{
+		Scoped* s = ScopeTable::lookup(id);
+		if(s == NULL) throw NotInScopeException(SymbolTable::name(id));
+		var = dynamic_cast<ScopedVariable*>(s);
+		if(var == NULL) throw SyntaxError(SymbolTable::name(id) + " is not a variable");
+		ScopeTable::reference(var);
+	}
+
 	ExpressionResult execute()
 	{
-		ScopedVariable* s = dynamic_cast<ScopedVariable*>(getScope(id));
-		assert(s != NULL);
-		RegAlloc::bindReg(s);
-		return std::make_shared<VarResult>(s);
+		assert(var != NULL);
+		int32_t value;
+		if(KnownValues::find(var, value)){
+			Stats::count(COUNT_KNOWN_READS);
+			return std::make_shared<ConstResult>(value);
+		}
+		RegAlloc::bindReg(var);
+		return std::make_shared<VarResult>(var);
+	}
+
+	int lower(IrBuilder& ir)
+	{
+		return ir.read(var);
+	}
+
+	ScopedVariable* variable()
+	{
+		return var;
 	}
 };
 
@@ -230,12 +329,14 @@ class Constant: public _Expression
 	int datai;
 	bool intType;
 public:
+	//Integer constants arrive already decoded by the scanner
+	Constant(int i){
+		intType = true;
+		datai = i;
+	}
 	Constant(std::string s, int t){
 		intType = true;
-		if(t == ParserBase::I_CONSTANT){
-			datai = parseInt(s);
-		}
-		else if(t == ParserBase::F_CONSTANT)
+		if(t == ParserBase::F_CONSTANT)
 		{
 			dataf = parseFloat(s);
 			intType = false;
@@ -251,6 +352,11 @@ public:
 	{
 		return std::make_shared<ConstResult>(datai);
 	}
+
+	int lower(IrBuilder& ir)
+	{
+		return ir.constant(datai);
+	}
 };
 
 class String: public _Expression
@@ -267,6 +373,11 @@ public:
 	{
 		return std::make_shared<LiteralResult>(StringBin::newLiteral(id));
 	}
+
+	int lower(IrBuilder& ir)
+	{
+		return ir.string(id);
+	}
 };
 
 
@@ -289,11 +400,22 @@ public:
 		return first->format() + ", " + next->format();
 	
 	}
+	void resolve()
+	{
+		first->resolve();
+		next->resolve();
+	}
 	ExpressionResult execute()
 	{
 		first->execute();
 		return  next->execute();
 	}
+
+	int lower(IrBuilder& ir)
+	{
+		first->lower(ir);
+		return next->lower(ir);
+	}
 };
 
 class ArgumentExpressionList: public _Expression
@@ -301,12 +423,14 @@ class ArgumentExpressionList: public _Expression
 	_Expression* first;
 	
 	ArgumentExpressionList* next;
+	bool calls;	//Whether first makes a call of its own
 	
 public:
 	ArgumentExpressionList(Branch* _1)
 	{
 		dynamic_assign(first, _1);
 		next = NULL;
+		calls = false;
 	}
 	
 	void extend(Branch* _1)
@@ -320,28 +444,48 @@ public:
 		return first->format() + ", " + (next?next->format():"");
 	
 	}
+	void resolve()
+	{
+		first->resolve();
+		if(next) next->resolve();
+	}
 	ExpressionResult execute()
 	{
-		executeEval(0);
+		std::vector<ExpressionResult> args;
+		evaluate(args);
 		return ExpressionResult();
 	}
 	
-	int executeEval(int i){
-		ExpressionResult eval = first->execute();
-		eval = eval->toRegisterable();
-		
-		CodeGen::push(new StackPushPop({eval->getRegisterable()->bind()}, true));
-		
-		int ret = i;
-		if(next){
-			ret = next->executeEval(i+1);
+	int size(){return next ? next->size() + 1 : 1;}
+
+	void markCalls(){calls = true;}
+
+	/*
+	Evaluates every argument into args, those making calls first so that the
+	values of the others aren't stored around them. Constants are left for
+	the call to put straight where they are passed.
+	*/
+	void evaluate(std::vector<ExpressionResult>& args)
+	{
+		args.resize(size());
+		evaluate(args, 0, true);
+		evaluate(args, 0, false);
+	}
+
+	void evaluate(std::vector<ExpressionResult>& args, size_t i, bool calling)
+	{
+		if(calls == calling){
+			ExpressionResult eval = first->execute();
+			if(eval->loc != CONST && eval->loc != LITERAL) eval = eval->toRegisterable();
+			args[i] = eval;
 		}
-		
-		RegAlloc::store(i);
-		CodeGen::push(new StackPushPop({i}, false));
-		
-		return ret;
-		
+		if(next) next->evaluate(args, i+1, calling);
+	}
+
+	void lower(IrBuilder& ir, std::vector<int>& args)
+	{
+		args.push_back(first->lower(ir));
+		if(next) next->lower(ir, args);
 	}
 	
 };
@@ -351,6 +495,9 @@ class FunctionCall: public _Expression
 	Identifier* iden;
 	ArgumentExpressionList* ael;
 
+	//Puts arguments from up to to in r0 up
+	void pass(std::vector<ExpressionResult>& args, size_t from, size_t to);
+
 public:
 	FunctionCall(Branch* _1){
 		dynamic_assign(iden, _1);
@@ -367,17 +514,68 @@ public:
 		return iden->format() + "(" + (ael?ael->format():"");
 	}
 	
+	//Calls go by name, so the callee may be external and is not looked up
+	void resolve();
+	
+	/*
+	Arguments past the fourth are pushed four at a time from r0-r3, the last
+	ones first so they end up in order above sp, before the first four are
+	put in r0-r3
+	*/
 	ExpressionResult execute()
 	{
-		if(ael){
-			ael->execute();
+		std::vector<ExpressionResult> args;
+		if(ael) ael->evaluate(args);
+		
+		size_t end = args.size();
+		CodeGen::alignArguments(end);
+		while(end > 4){
+			size_t from = end >= 8 ? end - 4 : 4;
+			pass(args, from, end);
+			Instr push = StackPushPop({}, true);
+			push.regList = (1 << (end - from)) - 1;
+			CodeGen::push(push);
+			end = from;
 		}
+		pass(args, 0, end);
 		
-		RegAlloc::storeAll();
-		CodeGen::push(new BBlock(iden->format(), true));
+		RegAlloc::storeCallerSaved();
+		CodeGen::call(LabelAlloc::symbol(iden->symbol()), args.size());
 		
 		return std::make_shared<TempResult>(TemporaryValue::create(0));
 	}
+
+	/*
+	Generates the call as the last thing the function does, if its arguments
+	all go in registers: a call to the function itself jumps back to the top
+	of its body with them as the new parameters, any other leaves the frame
+	first so that the callee returns straight to the caller
+	*/
+	bool tail()
+	{
+		int args = ael ? ael->size() : 0;
+		if(args > 4) return false;
+		std::vector<ExpressionResult> values;
+		if(ael) ael->evaluate(values);
+		pass(values, 0, args);
+
+		if(iden->symbol() != LoopLabelJump::getFunction()){
+			CodeGen::tailCall(LabelAlloc::symbol(iden->symbol()), args);
+			Stats::count(COUNT_TAIL_CALLS);
+			return true;
+		}
+		Instr jump = BBlock(LoopLabelJump::getTop(), false);
+		jump.regList = (1 << args) - 1;
+		CodeGen::push(jump);
+		Stats::count(COUNT_TAIL_RECURSION);
+		return true;
+	}
+
+	FunctionCall* call(){return this;}
+
+	//Defined after FuncDef, whose body they may inline or loop back to
+	int lower(IrBuilder& ir);
+	bool lowerRecursion(IrBuilder& ir);
 };
 
 class BracketedExpression: public _Expression
@@ -388,11 +586,16 @@ public:
 		dynamic_assign(exp, _1);
 	}
 	std::string format(){return "(" + exp->format() + ")";}
+	void resolve(){exp->resolve();}
 
 	ExpressionResult execute()
 	{
 		return exp->execute();
 	}
+
+	int lower(IrBuilder& ir){return exp->lower(ir);}
+	ScopedVariable* variable(){return exp->variable();}
+	FunctionCall* call(){return exp->call();}
 };
 
 
@@ -411,11 +614,16 @@ public:
 	{	
 		return postexp->format();
 	}
+	void resolve(){postexp->resolve();}
 
 	ExpressionResult execute()
 	{
 		return postexp->execute();
 	}
+
+	int lower(IrBuilder& ir){return postexp->lower(ir);}
+	ScopedVariable* variable(){return postexp->variable();}
+	FunctionCall* call(){return postexp->call();}
 };
 
 class ConditionalExpression: public _Expression
@@ -445,11 +653,22 @@ public:
 		if(mode == 0) return logicalorexp->format();
 		else return logicalorexp->format() + " ? " + exp->format() + " : " + condexp->format();
 	}
+	void resolve(){
+		logicalorexp->resolve();
+		if(mode == 0) return;
+		exp->resolve();
+		condexp->resolve();
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return logicalorexp->execute();
 		throw UnimplementedException("conditional");
 	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return logicalorexp->lower(ir);
+		return _Expression::lower(ir);
+	}
 };
 
 class LogicalOrExpression: public _Expression
@@ -476,11 +695,20 @@ public:
 		if(mode == 0) return logicalandexp->format();
 		else return logicalorexp->format() + " || " + logicalandexp->format();
 	}
+	void resolve(){
+		logicalandexp->resolve();
+		if(mode == 1) logicalorexp->resolve();
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return logicalandexp->execute();
 		throw UnimplementedException("logicalor");
 	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return logicalandexp->lower(ir);
+		return _Expression::lower(ir);
+	}
 };
 
 class LogicalAndExpression: public _Expression
@@ -507,11 +735,20 @@ public:
 		if(mode == 0) return inclusiveorexp->format();
 		else return logicalandexp->format() + " && " + inclusiveorexp->format();
 	}
+	void resolve(){
+		inclusiveorexp->resolve();
+		if(mode == 1) logicalandexp->resolve();
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return inclusiveorexp->execute();
 		throw UnimplementedException("logicaland");
 	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return inclusiveorexp->lower(ir);
+		return _Expression::lower(ir);
+	}
 };
 
 class InclusiveOrExpression: public _Expression
@@ -538,6 +775,16 @@ public:
 		if(mode == 0) return exclusiveorexp->format();
 		else return inclusiveorexp->format() + " | " + exclusiveorexp->format();
 	}
+	void resolve(){
+		exclusiveorexp->resolve();
+		if(mode == 1) inclusiveorexp->resolve();
+	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return exclusiveorexp->lower(ir);
+		int lhs = inclusiveorexp->lower(ir);
+		return ir.add(IR_OR, IR_INT, {lhs, exclusiveorexp->lower(ir)});
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return exclusiveorexp->execute();
@@ -552,7 +799,7 @@ public:
 		{
 			auto tempval = TemporaryValue::create();
 			int res = tempval->getReg();
-			CodeGen::push(new OrBlock(res, lhs->toRegisterable(), rhs));
+			CodeGen::push(OrBlock(res, lhs->toRegisterable(), rhs));
 			return std::make_shared<TempResult>(tempval);
 		}
 		else if(checkResult(lhs, rhs, CONST, REG))
@@ -560,12 +807,12 @@ public:
 			auto tempval = TemporaryValue::create();
 			int res = tempval->getReg();
 			orderResult(lhs, rhs, REG);
-			CodeGen::push(new OrBlock(res, lhs->toRegisterable(), rhs));
+			CodeGen::push(OrBlock(res, lhs->toRegisterable(), rhs));
 			return std::make_shared<TempResult>(tempval);
 		}
 		else
 		{
-			return std::make_shared<ConstResult>(lhs->getValue() && rhs->getValue());
+			return std::make_shared<ConstResult>(lhs->getValue() | rhs->getValue());
 		}
 	}
 };
@@ -594,11 +841,20 @@ public:
 		if(mode == 0) return andexp->format();
 		else return exclusiveorexp->format() + " ^ " + andexp->format();
 	}
+	void resolve(){
+		andexp->resolve();
+		if(mode == 1) exclusiveorexp->resolve();
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return andexp->execute();
 		throw UnimplementedException("exclusiveor");
 	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return andexp->lower(ir);
+		return _Expression::lower(ir);
+	}
 };
 
 class AndExpression: public _Expression
@@ -625,6 +881,16 @@ public:
 		if(mode == 0) return equalityexp->format();
 		else return andexp->format() + " & " + equalityexp->format();
 	}
+	void resolve(){
+		equalityexp->resolve();
+		if(mode == 1) andexp->resolve();
+	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return equalityexp->lower(ir);
+		int lhs = andexp->lower(ir);
+		return ir.add(IR_AND, IR_INT, {lhs, equalityexp->lower(ir)});
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return equalityexp->execute();
@@ -639,7 +905,7 @@ public:
 		{
 			auto tempval = TemporaryValue::create();
 			int res = tempval->getReg();
-			CodeGen::push(new AndBlock(res, lhs->toRegisterable(), rhs));
+			CodeGen::push(AndBlock(res, lhs->toRegisterable(), rhs));
 			return std::make_shared<TempResult>(tempval);
 		}
 		else if(checkResult(lhs, rhs, CONST, REG))
@@ -647,12 +913,12 @@ public:
 			auto tempval = TemporaryValue::create();
 			int res = tempval->getReg();
 			orderResult(lhs, rhs, REG);
-			CodeGen::push(new AndBlock(res, lhs->toRegisterable(), rhs));
+			CodeGen::push(AndBlock(res, lhs->toRegisterable(), rhs));
 			return std::make_shared<TempResult>(tempval);
 		}
 		else
 		{
-			return std::make_shared<ConstResult>(lhs->getValue() && rhs->getValue());
+			return std::make_shared<ConstResult>(lhs->getValue() & rhs->getValue());
 		}
 		
 	}
@@ -691,6 +957,17 @@ public:
 			 return ret;
 		}
 	}
+	void resolve(){
+		relationalexp->resolve();
+		if(mode == 1) equalityexp->resolve();
+	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return relationalexp->lower(ir);
+		int lhs = equalityexp->lower(ir);
+		int rhs = relationalexp->lower(ir);
+		return ir.add(IR_CMP, IR_BOOL, {lhs, rhs}, 0, (op == ParserBase::EQ_OP) ? EQ : NE);
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return relationalexp->execute();
@@ -703,18 +980,19 @@ public:
 		
 		if(checkResult(lhs, rhs, REG, REG))
 		{
-			CodeGen::push(new CMPBlock(lhs->toRegisterable(), rhs));
+			CodeGen::push(CMPBlock(lhs->toRegisterable(), rhs));
 			return std::make_shared<FlagsResult>((op == ParserBase::EQ_OP) ? EQ : NE);
 		}
 		else if(checkResult(lhs, rhs, CONST, REG))
 		{
 			orderResult(lhs, rhs, REG);
-			CodeGen::push(new CMPBlock(lhs->toRegisterable(), rhs));
+			CodeGen::push(CMPBlock(lhs->toRegisterable(), rhs));
 			return std::make_shared<FlagsResult>((op == ParserBase::EQ_OP) ? EQ : NE);
 		}
 		else
 		{
-			return std::make_shared<ConstResult>(lhs->getValue() == rhs->getValue());
+			bool equal = lhs->getValue() == rhs->getValue();
+			return std::make_shared<ConstResult>(equal == (op == ParserBase::EQ_OP));
 		}
 		
 	}
@@ -758,6 +1036,25 @@ public:
 			return ret;
 		}
 	}
+	void resolve(){
+		shiftexp->resolve();
+		if(mode == 1) relationalexp->resolve();
+	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return shiftexp->lower(ir);
+		int lhs = relationalexp->lower(ir);
+		int rhs = shiftexp->lower(ir);
+		Flag fl;
+		switch(op){
+			case '<': fl = LT; break;
+			case '>': fl = GT; break;
+			case ParserBase::LE_OP: fl = LE; break;
+			case ParserBase::GE_OP: fl = GE; break;
+			default: assert(false);
+		}
+		return ir.add(IR_CMP, IR_BOOL, {lhs, rhs}, 0, fl);
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return shiftexp->execute();
@@ -766,10 +1063,23 @@ public:
 		ExpressionResult lhs = relationalexp->execute();
 		ExpressionResult rhs = shiftexp->execute();
 		
+		if(checkResult(lhs, rhs, CONST, CONST))
+		{
+			int32_t l = lhs->getValue(), r = rhs->getValue();
+			bool holds;
+			switch(op){
+				case '<': holds = l < r; break;
+				case '>': holds = l > r; break;
+				case ParserBase::LE_OP: holds = l <= r; break;
+				default: holds = l >= r; break;
+			}
+			return std::make_shared<ConstResult>(holds);
+		}
+		
 		lhs = lhs->toRegisterable();
 		rhs = rhs->toRegisterable();
 		
-		CodeGen::push(new CMPBlock(lhs->toRegisterable(), rhs));
+		CodeGen::push(CMPBlock(lhs->toRegisterable(), rhs));
 		Flag fl;
 		switch(op){
 			case '<': fl = LT; break;
@@ -817,11 +1127,20 @@ public:
 			 return ret;
 		}
 	}
+	void resolve(){
+		addexp->resolve();
+		if(mode == 1) shiftexp->resolve();
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return addexp->execute();
 		throw UnimplementedException("shift");
 	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return addexp->lower(ir);
+		return _Expression::lower(ir);
+	}
 };
 
 class AddExpression: public _Expression
@@ -858,52 +1177,78 @@ public:
 			 return ret;
 		}
 	}
+	void resolve(){
+		multexp->resolve();
+		if(mode == 1) addexp->resolve();
+	}
+
+	int lower(IrBuilder& ir)
+	{
+		if (mode==0) return multexp->lower(ir);
+		int lhs = addexp->lower(ir);
+		return ir.add(op == '+' ? IR_ADD : IR_SUB, IR_INT, {lhs, multexp->lower(ir)});
+	}
 
+	/*
+	c + a * b and a * b + c are a single MLA when all three operands are in
+	registers; MLS, for c - a * b, needs ARMv6T2
+	*/
 	ExpressionResult execute()
 	{
-		if (mode==0) return addexp->execute();
-		
-		ExpressionResult lhs = multexp->execute();
-		ExpressionResult rhs = addexp->execute();
-		
-		if(checkResult(lhs, FLAGS))lhs = lhs->toRegisterable();
-		if(checkResult(rhs, FLAGS))rhs = rhs->toRegisterable();
-		
-		if(checkResult(lhs, rhs, REG, REG))
-		{
-			auto tempval = TemporaryValue::create();
-			int res = tempval->getReg();
+		if (mode==0) return multexp->execute();
 
-			if(op == '+') CodeGen::push(new AddBlock(res, lhs->toRegisterable(), rhs));
-			else CodeGen::push(new SubBlock(res, lhs->toRegisterable(), rhs));
-			return std::make_shared<TempResult>(tempval);
+		ExpressionResult lhs, rhs, a, b;
+		bool product;
+		if(op == '+' && addexp->factors(a, b)){
+			product = true;
+			rhs = multexp->execute();
+			if(checkResult(rhs, FLAGS))rhs = rhs->toRegisterable();
 		}
-		else if(checkResult(lhs, rhs, CONST, CONST))
-		{
-			if(op == '+') return std::make_shared<ConstResult>(lhs->getValue() + rhs->getValue());
-			else return std::make_shared<ConstResult>(lhs->getValue() - rhs->getValue());
+		else{
+			lhs = addexp->execute();
+			if(checkResult(lhs, FLAGS))lhs = lhs->toRegisterable();
+			product = multexp->factors(a, b);
+			if(!product) rhs = multexp->execute();
 		}
-		else if(checkResult(lhs, rhs, REG, CONST))
+
+		if(product)
 		{
-			auto tempval = TemporaryValue::create();
-			int res = tempval->getReg();
-			if(op == '+'){
-				orderResult(lhs, rhs, REG);
-				CodeGen::push(new AddBlock(res, lhs->toRegisterable(), rhs));
-				return std::make_shared<TempResult>(tempval);
-			}
-			
-			if(lhs->loc == REG){
-				CodeGen::push(new SubBlock(res, lhs->toRegisterable(), Imm(-rhs->getValue())));
+			ExpressionResult& acc = lhs ? lhs : rhs;
+			if(op == '+' && checkResult(a, b, REG, REG) && checkResult(acc, REG))
+			{
+				auto tempval = TemporaryValue::create();
+				int res = tempval->getReg();
+				CodeGen::push(MlaBlock(res, a->toRegisterable(), b->toRegisterable(), acc->toRegisterable()));
 				return std::make_shared<TempResult>(tempval);
 			}
-			
-			lhs = lhs->toRegisterable();
-			CodeGen::push(new RSBBlock(res, lhs->toRegisterable(), rhs));
-			return std::make_shared<TempResult>(tempval);
+			(lhs ? rhs : lhs) = multiply(a, b);
 		}
-		
-		assert(false);
+		return combine(lhs, rhs);
+	}
+
+private:
+	ExpressionResult combine(ExpressionResult lhs, ExpressionResult rhs)
+	{
+		if(checkResult(lhs, FLAGS))lhs = lhs->toRegisterable();
+		if(checkResult(rhs, FLAGS))rhs = rhs->toRegisterable();
+
+		if(checkResult(lhs, rhs, CONST, CONST))
+		{
+			uint32_t l = lhs->getValue(), r = rhs->getValue();
+			return std::make_shared<ConstResult>((int32_t)(op == '+' ? l + r : l - r));
+		}
+
+		auto tempval = TemporaryValue::create();
+		int res = tempval->getReg();
+		if(checkResult(lhs, CONST))
+		{
+			//Only the second operand can be an immediate
+			if(op == '+') CodeGen::push(AddBlock(res, rhs->toRegisterable(), lhs));
+			else CodeGen::push(RSBBlock(res, rhs->toRegisterable(), lhs));
+		}
+		else if(op == '+') CodeGen::push(AddBlock(res, lhs->toRegisterable(), rhs));
+		else CodeGen::push(SubBlock(res, lhs->toRegisterable(), rhs));
+		return std::make_shared<TempResult>(tempval);
 	}
 };
 
@@ -943,10 +1288,33 @@ public:
 			return ret;
 		}
 	}
+	void resolve(){
+		castexp->resolve();
+		if(mode == 1) multexp->resolve();
+	}
+
+	bool factors(ExpressionResult& a, ExpressionResult& b){
+		if(mode == 0 || op != '*') return false;
+		a = multexp->execute();
+		if(checkResult(a, FLAGS))a = a->toRegisterable();
+		b = castexp->execute();
+		if(checkResult(b, FLAGS))b = b->toRegisterable();
+		return true;
+	}
 
 	ExpressionResult execute(){
 		if (mode==0) return castexp->execute();
-		throw UnimplementedException("mult");
+
+		ExpressionResult lhs, rhs;
+		if(!factors(lhs, rhs)) throw UnimplementedException("mult");
+		return multiply(lhs, rhs);
+	}
+
+	int lower(IrBuilder& ir){
+		if (mode==0) return castexp->lower(ir);
+		if (op != '*') return _Expression::lower(ir);
+		int lhs = multexp->lower(ir);
+		return ir.add(IR_MUL, IR_INT, {lhs, castexp->lower(ir)});
 	}
 };
 
@@ -962,10 +1330,15 @@ public:
 	std::string format(){
 		return unaryexp->format();
 	}
+	void resolve(){unaryexp->resolve();}
 
 	ExpressionResult execute(){
 		return unaryexp->execute();
 	}
+
+	int lower(IrBuilder& ir){return unaryexp->lower(ir);}
+	ScopedVariable* variable(){return unaryexp->variable();}
+	FunctionCall* call(){return unaryexp->call();}
 };
 
 class UnaryExpression: public _Expression
@@ -982,14 +1355,25 @@ public:
 	std::string format(){
 		return postfixexp->format();
 	}
+	void resolve(){postfixexp->resolve();}
 
 	ExpressionResult execute(){
 		return postfixexp->execute();
 	}
+
+	int lower(IrBuilder& ir){return postfixexp->lower(ir);}
+	ScopedVariable* variable(){return postfixexp->variable();}
+	FunctionCall* call(){return postfixexp->call();}
 };
 
 class _Statement: public Branch
-{};
+{
+public:
+	//Adds the statement to the function's IR, see _Expression::lower
+	virtual void lower(IrBuilder&){
+		throw UnimplementedException("no IR for statement");
+	}
+};
 
 class ReturnType: public _Statement
 {
@@ -1009,13 +1393,28 @@ public:
 		return "return " + exp->format() + ";";
 	}
 	
+	void resolve()
+	{
+		if(exp) exp->resolve();
+	}
+	
 	void genCode()
 	{
 		if(exp){
+			FunctionCall* call = exp->call();
+			if(call && call->tail()) return;
 			ExpressionResult expr = exp->execute()->toRegisterable();
-			CodeGen::push(new MoveBlock(0, expr));
+			CodeGen::push(MoveBlock(0, expr));
 		}
-		CodeGen::push(new BBlock("." + LoopLabelJump::getReturn(), false));
+		CodeGen::push(BBlock(LoopLabelJump::getReturn(), false));
+	}
+
+	//Other tail calls are found by InstrSelect
+	void lower(IrBuilder& ir)
+	{
+		FunctionCall* call = exp ? exp->call() : NULL;
+		if(call && call->lowerRecursion(ir)) return;
+		ir.ret(exp ? exp->lower(ir) : -1);
 	}
 };
 
@@ -1030,9 +1429,19 @@ public:
 	
 	void genCode()
 	{
-		RegAlloc::storeAll();
-		if (contOrRet==0)CodeGen::push(new BBlock(LoopLabelJump::getContinue(), false));
-		else CodeGen::push(new BBlock(LoopLabelJump::getBreak(), false));
+		if (contOrRet==0){
+			RegAlloc::toLoopHeader();
+			CodeGen::push(BBlock(LoopLabelJump::getContinue(), false));
+		}
+		else{
+			RegAlloc::toLoopExit();
+			CodeGen::push(BBlock(LoopLabelJump::getBreak(), false));
+		}
+	}
+
+	void lower(IrBuilder& ir)
+	{
+		ir.jump(contOrRet==0 ? ir.continueTarget() : ir.breakTarget());
 	}
 	
 	std::string format()
@@ -1045,7 +1454,8 @@ public:
 
 class DeclarationSpec: public Branch
 {
-	
+public:
+	virtual bool isInline(){return false;}
 };
 
 class TypeSpec: public DeclarationSpec
@@ -1071,6 +1481,38 @@ public:
 
 };
 
+//inline or _Noreturn, in front of the rest of the specifiers
+class FunctionSpec: public DeclarationSpec
+{
+	int spec;
+	//Optional
+	DeclarationSpec* rest;
+
+public:
+	FunctionSpec(int s):
+		spec(s), rest(NULL)
+	{}
+
+	void extend(Branch* _1)
+	{
+		dynamic_assign(rest, _1);
+	}
+
+	std::string format()
+	{
+		std::string put = spec == ParserBase::INLINE ? "inline " : "_Noreturn ";
+		if(rest) put += rest->format();
+		return put;
+	}
+
+	void genCode()
+	{
+		if(rest) rest->genCode();
+	}
+
+	bool isInline(){return spec == ParserBase::INLINE || (rest && rest->isInline());}
+};
+
 class Pointer: public Branch
 {
 	public:
@@ -1082,10 +1524,11 @@ class Pointer: public Branch
 class DirectDeclarator: public Branch
 {
 	protected:
-	std::string identifier;
+	SymbolId identifier;
 	
 	public:
-		std::string getName(){return identifier;}
+		const std::string& getName(){return SymbolTable::name(identifier);}
+		SymbolId getSymbol(){return identifier;}
 };
 
 class DirectDeclaratorBase: public DirectDeclarator
@@ -1093,14 +1536,14 @@ class DirectDeclaratorBase: public DirectDeclarator
 {
 	
 public:
-	DirectDeclaratorBase(std::string i)
+	DirectDeclaratorBase(SymbolId i)
 	{
 		identifier = i;
 	}
 	
 	std::string format()
 	{
-		return identifier;
+		return getName();
 	}
 
 	void genCode(){}
@@ -1116,7 +1559,6 @@ class Declarator: public Branch
 	{
 		dynamic_assign(dd, b);
 		ptr = NULL;
-		scopeSearch.push_back(dd);
 	}
 	
 	Declarator(Branch* p, Branch* b)
@@ -1140,6 +1582,10 @@ class Declarator: public Branch
 		dd->genCode();
 	}
 	
+	void resolve(){
+		dd->resolve();
+	}
+	
 };
 
 
@@ -1148,6 +1594,8 @@ class InitDeclarator: public Branch
 {
 	Declarator* decl;
 	_Expression* init;
+	ScopedVariable* var;	//Created by declare
+	AssignmentExpression* assign;	//var = init, built by declare so codegen allocates nothing
 public:
 	InitDeclarator* next;
 	
@@ -1156,6 +1604,8 @@ public:
 		assert(dynamic_cast<DirectDeclaratorBase*>(std::get<1>(decl->getData())));
 		init = NULL;
 		next = NULL;
+		var = NULL;
+		assign = NULL;
 	}
 	
 	InitDeclarator(Branch* _1, Branch* _2){
@@ -1163,6 +1613,8 @@ public:
 		assert(dynamic_cast<DirectDeclaratorBase*>(std::get<1>(decl->getData())));
 		dynamic_assign(init, _2);
 		next = NULL;
+		var = NULL;
+		assign = NULL;
 	}
 	
 	std::string format()
@@ -1182,24 +1634,30 @@ public:
 	void extend(Branch* id)
 	{
 		if(next == NULL) dynamic_assign(next, id);
-		else
-		{
-			next->extend(id);
-			scopeSearch.push_back(id);	
+		else next->extend(id);
+	}
+	
+	//The variable is in scope from its own initialiser onwards
+	void declare(TypeSpec* type)
+	{
+		var = new ScopedVariable(decl, type);
+		ScopeTable::declare(var);
+		if(init){
+			init->resolve();
+			dynamic_assign(assign, new AssignmentExpression(new Identifier(var), new AssignmentOperator('='), init));
 		}
 	}
 
 	void genCode()	
 	{
-		std::string name = std::get<1>(decl->getData())->getName();
-		
-		if(init){
-		
-			AssignmentExpression* assign;
-			dynamic_assign(assign, new AssignmentExpression(new Identifier(name), new AssignmentOperator('='), init));
-			assign->execute();
-		}
-	
+		if(assign) assign->execute();
+		else KnownValues::forget(var);
+	}
+
+	void lower(IrBuilder& ir)
+	{
+		ir.declare(var);
+		if(init) ir.write(var, init->lower(ir));
 	}
 	
 };
@@ -1212,8 +1670,6 @@ public:
 	Declaration(Branch* _1, Branch* _2){
 		dynamic_assign(type, _1);
 		dynamic_assign(idl, _2);
-		
-		scopeSearch.push_back(idl);
 	}
 	
 
@@ -1222,20 +1678,26 @@ public:
 		return type->format() + " " + idl->format() + ';';
 	}
 
+	void resolve(){
+		for(InitDeclarator* idecl = idl; idecl != NULL; idecl = idecl->next)
+			idecl->declare(type);
+	}
+
 	void genCode(){
 
 		InitDeclarator* idecl = idl;
 		while(idecl!=NULL)
 		{
-			
-			Declarator* d = idecl->getDecl();
-			idecl->addScope(new ScopedVariable(d, type));
-			
 			idecl->genCode();
 			
 			idecl = idecl->next;
 		}
 	}
+
+	void lower(IrBuilder& ir){
+		for(InitDeclarator* idecl = idl; idecl != NULL; idecl = idecl->next)
+			idecl->lower(ir);
+	}
 };
 
 
@@ -1245,6 +1707,7 @@ class ParameterDecl: public Branch
 {
 	TypeSpec* type;
 	Declarator* decl;
+	ScopedVariable* var;
 	
 
 public:
@@ -1252,8 +1715,7 @@ public:
 		
 		dynamic_assign(decl, _2);
 		dynamic_assign(type, _1);
-		
-		
+		var = NULL;
 	}
 
 	std::string format()
@@ -1261,12 +1723,26 @@ public:
 		return type->format() + " " + decl->format();
 	}
 
+	void resolve(){
+		var = new ScopedVariable(decl, type);
+		ScopeTable::declare(var);
+	}
+
 	void genCode(){}
 	
+	//Past the fourth, parameters are passed on the stack
 	void genCode(int i){
-		ScopedVariable* sv = new ScopedVariable(decl, type);
-		addScope(sv);
-		RegAlloc::bindReg(sv, i);
+		if(i < 4) RegAlloc::bindReg(var, i);
+		else RegAlloc::bindStacked(var, 4 * (i - 4));
+	}
+
+	//Binds the i'th parameter to value, or with value -1 to what it is passed in
+	void lower(IrBuilder& ir, int i, int value){
+		if(value < 0){
+			value = ir.add(IR_PARAM, IR_INT, {}, i);
+		}
+		ir.declare(var);
+		ir.write(var, value);
 	}
 
 };
@@ -1313,13 +1789,31 @@ public:
 		return out;
 	}
 
+	void resolve()
+	{
+		for(size_t i=0; i<list.size(); i++)
+		{
+			list[i]->resolve();
+		}
+	}
+
 	void genCode()
 	{
 
 		for(size_t i=0; i<list.size(); i++)
 		{
 			list[i]->genCode(i);
-			scopeSearch.push_back(list[i]);
+		}
+	}
+
+	size_t size(){return list.size();}
+
+	//Parameters past the end of args are bound to what they are passed in
+	void lower(IrBuilder& ir, const std::vector<int>& args)
+	{
+		for(size_t i=0; i<list.size(); i++)
+		{
+			list[i]->lower(ir, i, i < args.size() ? args[i] : -1);
 		}
 	}
 };
@@ -1333,19 +1827,17 @@ public:
 	{
 		DirectDeclaratorBase* ddb;
 		dynamic_assign(ddb, _1);
-		identifier = ddb->getName();
+		identifier = ddb->getSymbol();
 		delete ddb;
 
 		dynamic_assign(ptl, _2);
-		
-		scopeSearch.push_back(ptl);
 	}
 
 	DirectDeclaratorFunc(Branch* _1)
 	{
 		DirectDeclaratorBase* ddb;
 		dynamic_assign(ddb, _1);
-		identifier = ddb->getName();
+		identifier = ddb->getSymbol();
 		delete ddb;
 
 		ptl = NULL;
@@ -1353,16 +1845,28 @@ public:
 	
 	std::string format()
 	{
-		std::string out = identifier + "(";
+		std::string out = getName() + "(";
 		if(ptl)out += ptl->format();
 		out += ")";
 		return out;
 	}
 
+	void resolve()
+	{
+		if(ptl)ptl->resolve();
+	}
+
 	void genCode()
 	{
 		if(ptl)ptl->genCode();
 	}
+
+	size_t parameters(){return ptl ? ptl->size() : 0;}
+
+	void lower(IrBuilder& ir, const std::vector<int>& args = std::vector<int>())
+	{
+		if(ptl)ptl->lower(ir, args);
+	}
 };
 
 
@@ -1395,10 +1899,17 @@ public:
 		return out;
 	}
 	
+	void resolve()
+	{
+		cmp->resolve();
+		then->resolve();
+		if(other) other->resolve();
+	}
+	
 	void genCode()
 	{
-		std::string notLabel = LabelAlloc::allocate();
-		std::string afterLabel;
+		Label notLabel = LabelAlloc::allocate();
+		Label afterLabel;
 		if(!other)afterLabel = notLabel;
 		else afterLabel = LabelAlloc::allocate();
 		
@@ -1407,11 +1918,12 @@ public:
 		ExpressionResult rx = cmp->execute();
 		if(checkResult(rx, REG))
 		{
-			CodeGen::push(new CMPBlock(rx->toRegisterable(), FlexSrc(0, true)));
-			CodeGen::push(new BranchBlock(notLabel, EQ));
+			CodeGen::push(CMPBlock(rx->toRegisterable(), FlexSrc(0, true)));
+			CodeGen::push(BranchBlock(notLabel, EQ));
 		}
 		else if(checkResult(rx, CONST))
 		{
+			Stats::count(COUNT_KNOWN_IFS);
 			if(rx->getValue() != 0)
 				then->genCode();
 			else if(other)
@@ -1421,30 +1933,74 @@ public:
 		}
 		else{
 			FlagsResult* flagResult = fit<FlagsResult>(rx);
-			CodeGen::push(new BranchBlock(notLabel, flagInvert(flagResult->getFlag())));
+			CodeGen::push(BranchBlock(notLabel, flagInvert(flagResult->getFlag())));
 			
 		}
 
-		auto regSnapshot = RegAlloc::createSnapshot();
+		rx = nullptr;	//Frees the condition's register before the arms
+
+		//Both paths are brought to one register layout where they meet:
+		//whatever is in the same register on both stays there
+		RegAlloc::Layout atBranch = RegAlloc::createSnapshot();
+		KnownValues::Values known = KnownValues::snapshot();
 
 		StackStore::begin();
 		then->genCode();
 		StackStore::end();
 		
+		RegAlloc::Layout joined = RegAlloc::joinLayout(RegAlloc::createSnapshot(), atBranch);
+		RegAlloc::reconcile(joined);
+		KnownValues::Values afterThen = KnownValues::snapshot();
+		
 		if(other)
 		{
-			RegAlloc::storeAll();
-			RegAlloc::restoreSnapshot(regSnapshot);
-
-			CodeGen::push(new BranchBlock(afterLabel));
-			CodeGen::push(new LabelBlock(notLabel));
+			CodeGen::push(BranchBlock(afterLabel));
+			CodeGen::push(LabelBlock(notLabel));
+			RegAlloc::restoreSnapshot(atBranch);
+			KnownValues::restore(known);
 			StackStore::begin();
 			other->genCode();
 			StackStore::end();
-			RegAlloc::storeAll();
+			RegAlloc::reconcile(joined);
 		}
+		else if(joined != atBranch)
+		{
+			//Skipping the arm needs code of its own to reach the layout
+			afterLabel = LabelAlloc::allocate();
+			CodeGen::push(BranchBlock(afterLabel));
+			CodeGen::push(LabelBlock(notLabel));
+			RegAlloc::restoreSnapshot(atBranch);
+			RegAlloc::reconcile(joined);
+		}
+
+		//Only what both ways here agree on stays known
+		KnownValues::join(other ? afterThen : known);
 		
-		CodeGen::push(new LabelBlock(afterLabel));		
+		CodeGen::push(LabelBlock(afterLabel));		
+	}
+
+	void lower(IrBuilder& ir)
+	{
+		int cond = cmp->lower(ir);
+		int thenBlock = ir.newBlock();
+		int elseBlock = other ? ir.newBlock() : -1;
+		int after = ir.newBlock();
+		ir.branch(cond, thenBlock, other ? elseBlock : after);
+
+		ir.start(thenBlock);
+		ir.seal(thenBlock);
+		then->lower(ir);
+		ir.jump(after);
+
+		if(other){
+			ir.start(elseBlock);
+			ir.seal(elseBlock);
+			other->lower(ir);
+			ir.jump(after);
+		}
+
+		ir.start(after);
+		ir.seal(after);
 	}
 };
 
@@ -1472,16 +2028,12 @@ public:
 		}
 		
 		next = NULL;
-
-		scopeSearch.push_back(_1);
 	}
 	
 	void extend(Branch* ext)
 	{
 		if(next==NULL) dynamic_assign(next, ext);
 		else next->extend(ext);
-
-		//scopeSearch.insert(scopeSearch.begin(), ext);
 	}
 	
 	
@@ -1495,6 +2047,14 @@ public:
 		return out;
 	}
 
+	void resolve()
+	{
+		if(stmtmode) stmt->resolve();
+		else decl->resolve();
+
+		if(next) next->resolve();
+	}
+
 	void genCode()
 	{
 		if(stmtmode) stmt->genCode();
@@ -1502,6 +2062,14 @@ public:
 
 		if(next) next->genCode();
 	}
+
+	void lower(IrBuilder& ir)
+	{
+		if(stmtmode) stmt->lower(ir);
+		else decl->lower(ir);
+
+		if(next) next->lower(ir);
+	}
 };
 
 
@@ -1533,10 +2101,20 @@ class ExpressionStatement: public _Statement
 		return out;
 	}
 
+	void resolve()
+	{
+		if(!empty)exp->resolve();
+	}
+
 	void genCode()
 	{
 		if(!empty)exp->execute();
 	}
+
+	void lower(IrBuilder& ir)
+	{
+		if(!empty)exp->lower(ir);
+	}
 	
 };
 
@@ -1563,16 +2141,30 @@ public:
 		return std::string("");
 	}
 
+	void resolve()
+	{
+		ScopeTable::begin();
+		if(!empty)bil->resolve();
+		ScopeTable::end();
+	}
+
 	void genCode()
 	{
 		StackStore::begin();
 		if(!empty)bil->genCode();
 		StackStore::end();
 	}		
+
+	void lower(IrBuilder& ir)
+	{
+		if(!empty)bil->lower(ir);
+	}
 };
 
 class ForLoop: public _Statement
 {
+	LoopVariables vars;
+
 	//for(
 	Declaration* decl;
 	ExpressionStatement* declstmt;
@@ -1605,7 +2197,6 @@ public:
 		{
 			dynamic_assign(decl, b);
 			declstmt = NULL;
-			scopeSearch.push_back(decl);
 		}
 		else
 		{
@@ -1628,47 +2219,103 @@ public:
 		return out;
 	}
 	
+	//A declaration in the first clause is only visible inside the loop
+	void resolve()
+	{
+		ScopeTable::begin();
+		if(decl)decl->resolve();
+		else declstmt->resolve();
+		ScopeTable::beginLoop(&vars);
+		expstmt->resolve();
+		if(exp)exp->resolve();
+		stmt->resolve();
+		ScopeTable::endLoop();
+		ScopeTable::end();
+	}
+	
+	//The increment runs after the body and is where continue goes
 	void genCode()
 	{
-		std::string compLabel = LabelAlloc::allocate();
-		std::string afterLabel = LabelAlloc::allocate();
+		Label compLabel = LabelAlloc::allocate();
+		Label afterLabel = LabelAlloc::allocate();
+		Label incLabel = LabelAlloc::allocate();
 		
-		LoopLabelJump::push(afterLabel, compLabel);
+		LoopLabelJump::push(afterLabel, incLabel);
 		
 		StackStore::begin();
 		
 		if(decl)decl->genCode();
 		else declstmt->genCode();
 
-		RegAlloc::storeAll();
+		RegAlloc::beginLoop(KnownValues::enterLoop(vars));
+		KnownValues::Values atTop = KnownValues::snapshot();
 
-		CodeGen::push(new LabelBlock(compLabel));
+		CodeGen::push(LabelBlock(compLabel));
 
 		if(!expstmt->empty)
 		{
 			auto expr = expstmt->exp->execute()->toRegisterable();
-			CodeGen::push(new CMPBlock(expr, Imm(0)));
-			CodeGen::push(new BranchBlock(afterLabel, EQ));
-
-		RegAlloc::storeAll();
+			CodeGen::push(CMPBlock(expr, Imm(0)));
+			CodeGen::push(BranchBlock(afterLabel, EQ));
 		}
-
-		exp->execute();
+		RegAlloc::markLoopExit();
 
 		stmt->genCode();
+		RegAlloc::toLoopHeader();
+
+		//Also reached by continue, from anywhere in the body
+		KnownValues::restore(atTop);
+		CodeGen::push(LabelBlock(incLabel));
+		if(exp)exp->execute();
+		RegAlloc::toLoopHeader();
 
 		StackStore::end();
-		RegAlloc::storeAll();
-		CodeGen::push(new BBlock(compLabel, false));
+		CodeGen::push(BBlock(compLabel, false));
 
-		CodeGen::push(new LabelBlock(afterLabel));
+		RegAlloc::endLoop();
+		KnownValues::restore(atTop);
+		CodeGen::push(LabelBlock(afterLabel));
 	
 		LoopLabelJump::pop();
 	}
+
+	void lower(IrBuilder& ir)
+	{
+		if(decl)decl->lower(ir);
+		else declstmt->lower(ir);
+
+		int header = ir.newBlock();
+		int body = ir.newBlock();
+		int inc = ir.newBlock();
+		int after = ir.newBlock();
+
+		ir.jump(header);
+		ir.start(header);
+		if(!expstmt->empty) ir.branch(expstmt->exp->lower(ir), body, after);
+		else ir.jump(body);
+
+		ir.start(body);
+		ir.seal(body);
+		ir.beginLoop(after, inc);
+		stmt->lower(ir);
+		ir.endLoop();
+		ir.jump(inc);
+
+		ir.start(inc);
+		ir.seal(inc);
+		if(exp)exp->lower(ir);
+		ir.jump(header);
+		ir.seal(header);
+
+		ir.start(after);
+		ir.seal(after);
+	}
 };
 
 class WhileLoop: public _Statement
 {
+	LoopVariables vars;
+
 	//while(
 	_Expression* exp;
 	//){
@@ -1691,22 +2338,32 @@ public:
 		return out;
 	}
 	
+	void resolve()
+	{
+		ScopeTable::beginLoop(&vars);
+		exp->resolve();
+		stmt->resolve();
+		ScopeTable::endLoop();
+	}
+	
 	void genCode()
 	{
-		std::string compLabel = LabelAlloc::allocate();
-		std::string afterLabel = LabelAlloc::allocate();;
+		Label compLabel = LabelAlloc::allocate();
+		Label afterLabel = LabelAlloc::allocate();
 
 
-		RegAlloc::storeAll();
+		RegAlloc::beginLoop(KnownValues::enterLoop(vars));
+		KnownValues::Values atTop = KnownValues::snapshot();
 
 		// Comparison expression
-		CodeGen::push(new LabelBlock(compLabel));
+		CodeGen::push(LabelBlock(compLabel));
 
 		ExpressionResult expr = exp->execute();
-		CodeGen::push(new CMPBlock(expr->toRegisterable(), Imm(0)));
+		CodeGen::push(CMPBlock(expr->toRegisterable(), Imm(0)));
+		expr = nullptr;
 
-		RegAlloc::storeAll();
-		CodeGen::push(new BranchBlock(afterLabel, EQ));
+		RegAlloc::markLoopExit();
+		CodeGen::push(BranchBlock(afterLabel, EQ));
 
 		// Body
 		LoopLabelJump::push(afterLabel, compLabel);
@@ -1717,15 +2374,39 @@ public:
 
 		StackStore::end();
 
-		RegAlloc::storeAll();
-		CodeGen::push(new BBlock(compLabel, false));
+		RegAlloc::toLoopHeader();
+		CodeGen::push(BBlock(compLabel, false));
 
 		LoopLabelJump::pop();
+		RegAlloc::endLoop();
+		KnownValues::restore(atTop);
 
 		// End
-		CodeGen::push(new LabelBlock(afterLabel));
+		CodeGen::push(LabelBlock(afterLabel));
 		
 	}
+
+	void lower(IrBuilder& ir)
+	{
+		int header = ir.newBlock();
+		int body = ir.newBlock();
+		int after = ir.newBlock();
+
+		ir.jump(header);
+		ir.start(header);
+		ir.branch(exp->lower(ir), body, after);
+
+		ir.start(body);
+		ir.seal(body);
+		ir.beginLoop(after, header);
+		stmt->lower(ir);
+		ir.endLoop();
+		ir.jump(header);
+		ir.seal(header);
+
+		ir.start(after);
+		ir.seal(after);
+	}
 };
 
 class FuncDef: public Branch
@@ -1733,6 +2414,8 @@ class FuncDef: public Branch
 		DeclarationSpec* declspec;	//Probably nothing more than a TypeSpec
 		Declarator* decl;			//Function name
 		CompoundStatement*	cmpstmt;	//Body of the function
+		int inlineSize = -1;	//IR values of the body alone, -1 if it can't be inlined
+		bool calls = false;	//Whether the body makes a call, set by resolve
 	
 	public:
 	FuncDef(Branch* _1, Branch* _2, Branch* _3)
@@ -1744,56 +2427,160 @@ class FuncDef: public Branch
 		
 		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
 		assert(ddf != NULL);
-		
-		scopeSearch.push_back(decl);
-		
 	}
 	
-	std::string getIdentifier()
+	SymbolId getIdentifier()
 	{
 		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
 		
-		return ddf->getName();
+		return ddf->getSymbol();
 	}
 	
 	std::string format()
 	{
 		return declspec->format() + " " + decl->format() + "\n{" + cmpstmt->format() + "\n}";
 	}
+	
+	//Parameters get a scope of their own around the body
+	void resolve()
+	{
+		ScopeTable::begin();
+		decl->resolve();
+		cmpstmt->resolve();
+		ScopeTable::end();
+	}
+
+	//Builds and optimizes the function's IR, or returns false if it uses
+	//anything the IR doesn't cover; those are generated directly
+	bool lower(IrFunction& fn)
+	{
+		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
+		try{
+			IrBuilder ir(fn, this, IrBuilder::INLINE_BUDGET);
+			ddf->lower(ir);
+			ir.beginBody();
+			cmpstmt->lower(ir);
+			ir.finish();
+		}
+		catch(UnimplementedException&){
+			Stats::count(COUNT_IR_FALLBACKS);
+			return false;
+		}
+		catch(SyntaxError&){
+			Stats::count(COUNT_IR_FALLBACKS);
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	Sizes the body for inlining by building its IR on its own, before any
+	function is generated, so generating them in parallel only reads it
+	*/
+	void measure()
+	{
+		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
+		IrFunction fn;
+		try{
+			IrBuilder ir(fn, this, 0);
+			ddf->lower(ir);
+			ir.beginBody();
+			cmpstmt->lower(ir);
+		}
+		catch(UnimplementedException&){
+			return;
+		}
+		catch(SyntaxError&){
+			return;
+		}
+		inlineSize = fn.values.size();
+	}
+
+	size_t parameters()
+	{
+		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
+		return ddf->parameters();
+	}
+
+	//Whether a call with n arguments could take the body's place
+	bool inlinable(size_t n, int& size)
+	{
+		size = inlineSize;
+		return inlineSize >= 0 && parameters() == n;
+	}
+
+	bool isInline(){return declspec->isInline();}
+
+	void markCalls(){calls = true;}
+
+	//The body in place of a call, returning what it returns
+	int lowerInline(IrBuilder& ir, const std::vector<int>& args)
+	{
+		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
+		ir.beginInline(this, inlineSize);
+		ddf->lower(ir, args);
+		cmpstmt->lower(ir);
+		return ir.endInline();
+	}
+
+	//A tail call of the function to itself, which sets the parameters to args
+	//and goes back to the top of the body
+	void lowerRecursion(IrBuilder& ir, const std::vector<int>& args)
+	{
+		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
+		ddf->lower(ir, args);
+		ir.recurse();
+	}
 
 	void genCode()
 	{
 		DirectDeclaratorFunc* ddf = dynamic_cast<DirectDeclaratorFunc*>(std::get<1>(decl->getData()));
 		
-		std::string fname = ddf->getName();
-		
-		CodeGen::push(new TextBlock("    .global " + fname));
-
-		if(fname!="main")CodeGen::push(new LabelBlock(ddf->getName()));
-		else CodeGen::push(new TextBlock(ddf->getName() + ":"));
+		const std::string& fname = ddf->getName();
+		size_t start = CodeGen::size();
 		
-		CodeGen::push(new StackPushPop({11,14}, true));
-		CodeGen::push(new TextBlock("    add fp, sp, #0"));
+		CodeGen::push(GlobalBlock(LabelAlloc::symbol(ddf->getSymbol())));
+		CodeGen::push(LabelBlock(LabelAlloc::symbol(ddf->getSymbol())));
 		
-		LoopLabelJump::setReturn(getIdentifier() + "return");
+		Label returnLabel = LabelAlloc::named("." + fname + "return");
+		LoopLabelJump::setReturn(returnLabel);
+		LoopLabelJump::setFunction(ddf->getSymbol());
 		
 		
 		StackStore::beginFunc();
-		RegAlloc::begin();
+		RegAlloc::begin(calls);
+		KnownValues::begin();
+		size_t body = CodeGen::size();
+
+		//-O goes through the IR, which is always allocated by linear scan
+		IrFunction ir;
+		bool lowered = IrFunction::enabled && lower(ir);
+		if(lowered) InstrSelect::lower(ir);
+		else{
+			declspec->genCode();
+			decl->genCode();
+			
+			
+			
+			cmpstmt->genCode();
+		}
 
-		declspec->genCode();
-		decl->genCode();
-		
-		
+		//Tail calls to the function itself go back to after the prologue and
+		//before its parameters are taken from r0-r3, outside what is allocated
+		size_t allocated = body;
+		if(LoopLabelJump::hasTop()){
+			std::vector<Instr>& code = CodeGen::instructions();
+			code.insert(code.begin() + body, LabelBlock(LoopLabelJump::getTop()));
+			allocated++;
+		}
 		
-		cmpstmt->genCode();
+		CodeGen::push(LabelBlock(returnLabel));
 		
-		CodeGen::push(new LabelBlock("."+getIdentifier() + "return"));
+		if(RegAlloc::linearScan || lowered) LinearScan::allocate(allocated);
 		
+		Frame::build(body, returnLabel, StackStore::endFunc());
 		
-		StackStore::endFunc();
-		CodeGen::push(new TextBlock("    add sp, fp, #0"));
-		CodeGen::push(new StackPushPop({11,15}, false));
+		Peephole::run(start);
 	}
 
 };
@@ -1811,13 +2598,11 @@ class TranslationUnit: public Branch
 		if(dynamic_cast<FuncDef*>(_1))
 		{
 			dynamic_assign(funcdef, _1);
-			addScope(new ScopedFunction(funcdef->getIdentifier()));
 			decl = NULL;
 		}
 		else
 		{
 			dynamic_assign(decl, _1);
-			scopeSearch.push_back(decl);
 			funcdef = NULL;
 		}
 		next = NULL;
@@ -1840,23 +2625,89 @@ class TranslationUnit: public Branch
 	}
 
 	
+	void resolve()
+	{
+		if(decl)decl->resolve();
+		else{
+			//Declared before its body so it can call itself
+			ScopeTable::declare(new ScopedFunction(funcdef->getIdentifier()));
+			Compilation::current().functions[funcdef->getIdentifier()] = funcdef;
+			funcdef->resolve();
+		}
+		
+		if(next) next->resolve();
+	}
+
 	void genCode()
 	{
-		if(decl)decl->genCode();
-		else funcdef->genCode();
+		Compilation& unit = Compilation::current();
+		if(IrFunction::enabled){
+			for(TranslationUnit* t = this; t != NULL; t = t->next){
+				if(t->funcdef) t->funcdef->measure();
+			}
+		}
 		
-		if(next) next->genCode();
+		//Global declarations are shared by the functions that use them, so
+		//those units are generated one item at a time
+		std::vector<FuncDef*> funcs;
+		for(TranslationUnit* t = this; t != NULL; t = t->next){
+			if(t->decl){
+				funcs.clear();
+				break;
+			}
+			funcs.push_back(t->funcdef);
+		}
+		
+		if(unit.pool == NULL || unit.pool->size() == 1 || funcs.size() < 2){
+			for(TranslationUnit* t = this; t != NULL; t = t->next){
+				if(t->funcdef){
+					t->funcdef->genCode();
+					continue;
+				}
+				size_t from = CodeGen::size();
+				t->decl->genCode();
+				if(RegAlloc::linearScan) LinearScan::allocate(from);
+				Peephole::run(from);
+			}
+			return;
+		}
+		
+		//Each function gets its own buffer, labels and allocators; the
+		//buffers are appended in source order so the output matches serial
+		std::vector<CodeBuffer> buffers(funcs.size());
+		std::thread::id owner = std::this_thread::get_id();
+		TaskGroup group(*unit.pool);
+		for(size_t i=0; i<funcs.size(); i++){
+			FuncDef* f = funcs[i];
+			CodeBuffer* b = &buffers[i];
+			group.run([&unit, f, b, owner]{
+				Compilation::Scope useUnit(unit);
+				CodeBuffer::Scope useBuffer(*b);
+				if(std::this_thread::get_id() == owner){
+					f->genCode();
+					return;
+				}
+				//The caller's codegen timer only sees its own thread
+				Stats::Timer time(PHASE_CODEGEN, true);
+				f->genCode();
+			});
+		}
+		group.wait();
+		
+		for(size_t i=0; i<buffers.size(); i++){
+			unit.code.append(buffers[i]);
+		}
 	}
 	
 };
 
 class TopBranch
 {
-	static TranslationUnit* tu;
+	static TranslationUnit*& tu();	//Root of the unit being compiled
 
 	public:
-		static void set(TranslationUnit* t){tu = t;}
-		static TranslationUnit* get(){return tu;}
+		static void set(TranslationUnit* t){tu() = t;}
+		static TranslationUnit* get(){return tu();}
 };
 
 #endif
@@ -0,0 +1,82 @@
+#include "Cfg.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+//Whether control never goes on to the next instruction
+static bool endsFlow(const Instr& i)
+{
+	if(i.op == OP_B) return i.cond == NONE;
+	return i.returns();
+}
+
+/*
+Splits the code at labels and after branches and returns. Branches to labels
+outside the code don't get an edge.
+*/
+Cfg::Cfg(const std::vector<Instr>& code, size_t from, size_t to)
+{
+	std::unordered_map<int32_t, int> labelBlock;
+	bool ended = true;
+	for(size_t k=from; k<to; k++){
+		const Instr& i = code[k];
+		if(ended || i.op == OP_LABEL){
+			Block b;
+			b.first = k;
+			blockList.push_back(b);
+		}
+		blockList.back().last = k;
+		if(i.op == OP_LABEL) labelBlock[i.imm] = blockList.size() - 1;
+		ended = (i.op == OP_B && i.cond != NEVER) || endsFlow(i);
+	}
+
+	for(size_t b=0; b<blockList.size(); b++){
+		const Instr& last = code[blockList[b].last];
+		if(last.op == OP_B && last.cond != NEVER){
+			auto it = labelBlock.find(last.imm);
+			if(it != labelBlock.end()) blockList[b].succ.push_back(it->second);
+		}
+		if(!endsFlow(last) && b + 1 < blockList.size()){
+			std::vector<int>& succ = blockList[b].succ;
+			if(std::find(succ.begin(), succ.end(), (int)b + 1) == succ.end()) succ.push_back(b + 1);
+		}
+	}
+	for(size_t b=0; b<blockList.size(); b++){
+		for(size_t s=0; s<blockList[b].succ.size(); s++){
+			blockList[blockList[b].succ[s]].pred.push_back(b);
+		}
+	}
+}
+
+void Cfg::analyse()
+{
+	if(blockList.empty()) return;
+	order = FlowGraph<Block>::reversePostorder(blockList);
+	std::vector<int> idom = FlowGraph<Block>::dominators(blockList, order);
+	for(size_t n=1; n<order.size(); n++){
+		int b = order[n];
+		blockList[b].idom = idom[b];
+		blockList[idom[b]].dominated.push_back(b);
+	}
+
+	//Outermost loops first, so inner ones overwrite them
+	loopList = FlowGraph<Block>::loops(blockList, order, idom);
+	for(size_t l=loopList.size(); l-- > 0;){
+		for(int b: order){
+			if(loopList[l].in[b]) blockList[b].loop = l;
+		}
+	}
+}
+
+bool Cfg::dominates(int a, int b) const
+{
+	if(!reachable(b)) return false;
+	while(b != a && b != 0) b = blockList[b].idom;
+	return b == a;
+}
+
+int Cfg::blockOf(size_t k) const
+{
+	auto it = std::upper_bound(blockList.begin(), blockList.end(), k,
+		[](size_t k, const Block& b){return k < b.first;});
+	return it - blockList.begin() - 1;
+}
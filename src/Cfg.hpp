@@ -0,0 +1,55 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <vector>
+#include <cstddef>
+#include "CodeGen.hpp"
+#include "FlowGraph.hpp"
+
+/*
+Control flow graph of a stretch of generated code, normally one function.
+Blocks start at labels and after branches; each has its successor and
+predecessor edges. analyse() adds the FlowGraph analysis: each block's
+immediate dominator and innermost loop, and the natural loops of the back
+edges, one per header, nested in a tree by containment. Passes that only
+need the blocks, like LinearScan, don't pay for it. The graph refers to
+instruction indices, so it has to be built again after a pass inserts or
+removes instructions.
+*/
+class Cfg
+{
+public:
+	struct Block
+	{
+		size_t first, last;	//Instruction indices, inclusive
+		std::vector<int> succ;
+		std::vector<int> pred;
+		int idom = -1;		//Immediate dominator, -1 for the entry and unreachable blocks
+		std::vector<int> dominated;	//Blocks whose immediate dominator this is
+		int loop = -1;		//Innermost loop containing it
+	};
+
+	//Innermost first, so a loop's parent always comes after it
+	typedef FlowGraph<Block>::Loop Loop;
+
+	Cfg(const std::vector<Instr>& code, size_t from, size_t to);
+
+	void analyse();
+
+	const std::vector<Block>& blocks() const {return blockList;}
+	const std::vector<Loop>& loops() const {return loopList;}
+	const std::vector<int>& reversePostorder() const {return order;}
+
+	int blockOf(size_t k) const;	//Block holding instruction k
+	bool reachable(int b) const {return b == 0 || blockList[b].idom >= 0;}
+	bool dominates(int a, int b) const;
+	bool inLoop(int l, int b) const {return loopList[l].in[b];}
+	int loopDepth(int b) const {return blockList[b].loop < 0 ? 0 : loopList[blockList[b].loop].depth;}
+
+private:
+	std::vector<Block> blockList;
+	std::vector<Loop> loopList;
+	std::vector<int> order;
+};
+
+#endif
@@ -1,37 +1,263 @@
 #include "CodeGen.hpp"
 #include "Allocation.hpp"
+#include "Stats.hpp"
+#include <algorithm>
 
-void CodeGen::push(CodeBlock* p)
+TextBlock::TextBlock(std::string s):
+	Instr(make(OP_TEXT, NONE, -1, -1, Imm(CodeGen::addText(s))))
+{}
+
+//r12 is never allocated, so without linear scan it can hold the constant
+//until the instruction it is built for has read it
+FlexSrc::FlexSrc(ExpressionResult expr)
 {
-	blocks.push_back(p);
+	if(expr->isRegisterable()){
+		value = expr->getRegisterable()->bind();
+		return;
+	}
+	value = expr->getValue();
+	if(Instr::encodable(value)){
+		imm = true;
+		return;
+	}
+	int reg = RegAlloc::linearScan ? RegAlloc::newVirtual() : RegAlloc::getScratch();
+	CodeGen::push(ConstBlock(reg, value));
+	value = reg;
 }
 
-void CodeGen::pushBegin(CodeBlock* p)
+size_t CodeGen::push(const Instr& i)
 {
-	blocks.insert(blocks.begin(),p);
+	std::vector<Instr>& instrs = state().instrs;
+	instrs.push_back(i);
+	return instrs.size() - 1;
 }
 
-bool CodeGen::rebindResultReg(int r)
+void CodeGen::pushBegin(const Instr& i)
 {
-	
-	RegisterResultBlock* rr = dynamic_cast<RegisterResultBlock*>(blocks.back());
-	if (rr == NULL) return false;
-	int firstReg = rr->regD;
-	if(RegAlloc::regs[rr->regD] != NULL) return false;
+	std::vector<Instr>& instrs = state().instrs;
+	instrs.insert(instrs.begin(), i);
+}
 
-	rr->rebindResult(r);
-	
-	
-	while(true)
-	{
-		RegisterResultBlock* rr = dynamic_cast<RegisterResultBlock*>(blocks.back());
-		if (rr == NULL) return true;
+//An odd number of arguments on the stack gets a word above them, which
+//keeps sp 8-byte aligned at the call
+static bool padded(int args)
+{
+	return args > 4 && (args - 4) % 2 == 1;
+}
+
+void CodeGen::alignArguments(int args)
+{
+	if(padded(args)) push(SubBlock(13, 13, Imm(4)));
+}
+
+void CodeGen::call(Label callee, int args)
+{
+	Instr call = BBlock(callee, true);
+	call.regList = (1 << std::min(args, 4)) - 1;	//Arguments read from r0-r3
+	push(call);
+	if(args > 4) push(AddBlock(13, 13, Imm(4 * (args - 4 + padded(args)))));
+}
+
+void CodeGen::tailCall(Label callee, int args)
+{
+	Instr jump = BBlock(callee, false);
+	jump.regList = (1 << args) - 1;
+	push(jump);
+}
+
+int CodeGen::addText(std::string s)
+{
+	std::vector<std::string>& text = state().text;
+	text.push_back(s);
+	return text.size() - 1;
+}
+
+//Stack slots are addressed from fp, or from sp in functions without one
+static const char* slotBase(const Instr& i)
+{
+	return i.rn == 13 ? "sp" : "fp";
+}
 
-		if(RegAlloc::regs[rr->regD] != NULL) return true;
-		if(rr->regD != firstReg) return true;
+/*
+Name tables for the buffered emitter, with their lengths precomputed
+*/
+struct Name
+{
+	const char* s;
+	unsigned char n;
+};
+
+#define NAME(str) {str, sizeof(str) - 1}
+
+static const Name regTable[] = {
+	NAME("r0"), NAME("r1"), NAME("r2"), NAME("r3"), NAME("r4"), NAME("r5"), NAME("r6"), NAME("r7"),
+	NAME("r8"), NAME("r9"), NAME("r10"), NAME("r11"), NAME("r12"), NAME("r13"), NAME("r14"), NAME("r15")
+};
+
+static const Name flagTable[] = {
+	NAME("EQ"), NAME("NE"), NAME("MI"), NAME("PL"), NAME("GT"), NAME("LT"), NAME("GE"), NAME("LE"), NAME(""), NAME("")
+};
+
+static const Name opTable[] = {
+	NAME("    MOV"), NAME("    MVN"), NAME("    ADD"), NAME("    SUB"), NAME("    RSB"), NAME("    AND"), NAME("    ORR"), NAME("    CMP"),
+	NAME("    MUL"), NAME("    MLA"),
+	NAME("    STR"), NAME("    LDR"), NAME("    LDR"), NAME("    LDR"), NAME("    STMFD sp!, {"), NAME("    LDMFD sp!, {"),
+	NAME("    B"), NAME("    BL ")
+};
+
+#undef NAME
+
+static inline void putName(AsmWriter& w, const Name& n)
+{
+	w.put(n.s, n.n);
+}
+
+static inline void putOp2(AsmWriter& w, const Instr& i)
+{
+	if(i.immOperand()){
+		w.put('#');
+		w.putInt(i.imm);
+	}
+	else{
+		putName(w, regTable[i.rm]);
+		if(i.imm == 0) return;
+		w.put(", LSL #");
+		w.putInt(i.imm);
+	}
+}
+
+static void putLabel(AsmWriter& w, Label l)
+{
+	if(LabelAlloc::isNamed(l)){
+		w.put(LabelAlloc::namedString(l));
+		return;
+	}
+	if((l & LABEL_KIND_MASK) == LABEL_LOCAL) w.put(".L");
+	else w.put(".literal_");
+	w.putInt(LabelAlloc::number(l));
+}
+
+/*
+Print the stream as assembly, straight into the output buffer. Instructions
+with no effect have already been taken out by Peephole.
+*/
+void CodeGen::emit(AsmWriter& w)
+{
+	const std::vector<Instr>& instrs = state().instrs;
+	const std::vector<std::string>& text = state().text;
 
-		rr->rebindResult(r);
-	
+	for(size_t n=0; n<instrs.size(); n++){
+		const Instr& i = instrs[n];
+		switch(i.op){
+			case OP_ADD:
+			case OP_SUB:
+			case OP_RSB:
+			case OP_AND:
+			case OP_ORR:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", ");
+				putName(w, regTable[i.rn]);
+				w.put(", ");
+				putOp2(w, i);
+				break;
+			case OP_MOV:
+			case OP_MVN:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", ");
+				putOp2(w, i);
+				break;
+			case OP_CMP:
+				putName(w, opTable[i.op]);
+				w.put(' ');
+				putName(w, regTable[i.rn]);
+				w.put(", ");
+				putOp2(w, i);
+				break;
+			case OP_MUL:
+			case OP_MLA:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", ");
+				putName(w, regTable[i.rn]);
+				w.put(", ");
+				putName(w, regTable[i.rm]);
+				if(!i.accumulates()) break;
+				w.put(", ");
+				putName(w, regTable[i.imm]);
+				break;
+			case OP_STR:
+			case OP_LDR:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", [");
+				w.put(slotBase(i), 2);
+				w.put(", #");
+				w.putInt(i.imm);
+				w.put(']');
+				break;
+			case OP_LDRLIT:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", =");
+				putLabel(w, i.imm);
+				break;
+			case OP_LDRCONST:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putName(w, regTable[i.rd]);
+				w.put(", =");
+				w.putInt(i.imm);
+				break;
+			case OP_PUSH:
+			case OP_POP:
+			{
+				putName(w, opTable[i.op]);
+				bool first = true;
+				for(int r=0; r<16; r++){
+					if(!(i.regList & (1 << r))) continue;
+					if(!first) w.put(", ");
+					putName(w, regTable[r]);
+					first = false;
+				}
+				w.put('}');
+				break;
+			}
+			case OP_B:
+				putName(w, opTable[i.op]);
+				putName(w, flagTable[i.cond]);
+				w.put(' ');
+				putLabel(w, i.imm);
+				break;
+			case OP_BL:
+				putName(w, opTable[i.op]);
+				putLabel(w, i.imm);
+				break;
+			case OP_LABEL:
+				putLabel(w, i.imm);
+				w.put(':');
+				break;
+			case OP_GLOBAL:
+				w.put("    .global ");
+				putLabel(w, i.imm);
+				break;
+			case OP_TEXT:
+				w.put(text[i.imm]);
+				break;
+		}
+		w.put('\n');
 	}
 }
 
@@ -44,6 +270,8 @@ Flag flagInvert(Flag f)
 		case LE: return GT;
 		case GE: return LT;
 		case LT: return GE;
+		case MI: return PL;
+		case PL: return MI;
 		case NONE: return NEVER;
 		default : assert(false);
 	}
@@ -5,9 +5,11 @@
 #include <string>
 #include <iostream>
 #include <cassert>
-#include <exception>
+#include <cstdint>
 
 #include "ExpressionResultBase.hpp"
+#include "LabelAlloc.hpp"
+#include "AsmWriter.hpp"
 
 enum Flag
 {
@@ -16,47 +18,6 @@ enum Flag
 
 Flag flagInvert(Flag);
 
-class CodeAbortException: public std::exception
-{};
-
-class CodeBlock
-{
-public:
-	virtual std::string format()=0;
-	
-	std::string flagToStr(Flag f)
-	{
-		switch(f){
-			case EQ: return "EQ";
-			case NE: return "NE";
-			case MI: return "MI";
-			case PL: return "PL";
-			case GT: return "GT";
-			case LT: return "LT";
-			case GE: return "GE";
-			case LE: return "LE";
-			case NONE: return "";
-			case NEVER: throw CodeAbortException();
-			default : assert(false);
-		}
-	}
-};
-
-class RegisterResultBlock: public CodeBlock
-{
-	friend class CodeGen;
-	protected:
-	int regD;
-	public:
-	RegisterResultBlock(int r):
-		regD(r)
-	{}
-	
-	void rebindResult(int r){
-		regD = r;
-	}
-};
-
 class Imm{
 	public:
 	int value;
@@ -103,10 +64,6 @@ class Src{
 		assert(expr->isRegisterable());
 		value = expr->getRegisterable()->bind();
 	}
-
-	std::string render(){
-		return "r" + std::to_string((long long)value);
-	}
 };
 
 /*
@@ -126,338 +83,281 @@ class FlexSrc: public Src{
 		Src(i.value), imm(true)
 	{}
 
-	FlexSrc(ExpressionResult expr){
-		if(expr->isRegisterable()){
-			value = expr->getRegisterable()->bind();
-		}
-		else{
-			imm = true;
-			value = expr->getValue();
-		}
-	}
+	//A constant that no immediate can hold is built in a register first
+	FlexSrc(ExpressionResult expr);
 	FlexSrc(RegExpressionResult expr){
 		value = expr->getRegisterable()->bind();
 	}
 
-	std::string render(){
-		if (!imm) return Src::render();
-		return "#" + std::to_string((long long)value);
-	}
-
 	operator int(){
 		return value;
 	}
 };
 
-class MoveBlock: public RegisterResultBlock
+enum Opcode
 {
-	FlexSrc src;
-	Flag condCode;
+	OP_MOV, OP_MVN, OP_ADD, OP_SUB, OP_RSB, OP_AND, OP_ORR, OP_CMP,
+	OP_MUL, OP_MLA,		//rn * rm, MLA adding it to register imm
+	OP_STR, OP_LDR,		//Stack slot at fp + imm
+	OP_LDRLIT,		//Address of label imm
+	OP_LDRCONST,		//Constant imm, from the literal pool
+	OP_PUSH, OP_POP,	//STMFD/LDMFD sp! of regList
+	OP_B, OP_BL,
+	OP_LABEL, OP_GLOBAL,
+	OP_TEXT			//Verbatim entry imm of the text pool
+};
 
-public:
-	MoveBlock(Dest d, FlexSrc _src, Flag co = NONE):
-		RegisterResultBlock(d), src(_src), condCode(co)
-	{}
-	
+/*
+A single generated instruction. Plain data, so the whole function body is one
+flat vector that later passes and the printer walk without virtual calls.
+*/
+struct Instr
+{
+	uint8_t op;
+	uint8_t cond;		//Flag the instruction executes under
+	uint16_t regList;	//One bit per register for PUSH/POP, the argument registers of BL or a tail call
+	int32_t rd;		//Registers from FIRST_VIRTUAL up are virtual, see LinearScan
+	int32_t rn;
+	int32_t rm;		//Register operand, or -1 when imm is the operand
+	int32_t imm;		//Immediate, stack offset, label or text index; LSL of a register operand
+
+	static Instr make(Opcode op, Flag cond, int rd, int rn, FlexSrc op2)
+	{
+		Instr i;
+		i.op = op;
+		i.cond = cond;
+		i.rd = rd;
+		i.rn = rn;
+		i.rm = op2.imm ? -1 : op2.value;
+		i.regList = 0;
+		i.imm = op2.imm ? op2.value : 0;
+		return i;
+	}
+
+	bool immOperand() const
+	{
+		return rm < 0;
+	}
 
+	//Whether v fits an operand immediate: 8 bits rotated right by an even amount
+	static bool encodable(int32_t v)
+	{
+		uint32_t u = v;
+		for(int r=0; r<32; r+=2){
+			if((u << r | u >> ((32 - r) & 31)) <= 0xff) return true;
+		}
+		return false;
+	}
 
-	std::string format()
+	bool accumulates() const
 	{
-		std::string out = std::string("    MOV");
-		out += flagToStr(condCode);
-		
-		out += " r" + std::to_string((long long)regD);
-		out += ", ";
-		out += src.render();
-		return out;
+		return op == OP_MLA;
 	}
 
+	//Popping lr into pc, or moving it there in a function without a frame
+	bool returns() const
+	{
+		return (op == OP_POP && (regList & (1 << 15))) || (op == OP_MOV && rd == 15);
+	}
 };
 
-class BranchBlock: public CodeBlock
+/*
+Builders for each kind of instruction. They coerce their operands into
+registers and produce a plain Instr for CodeGen::push.
+*/
+struct MoveBlock: public Instr
 {
-	std::string label;
-	Flag condCode;
-
-public:
-	BranchBlock(std::string l, Flag co = NONE):
-		label(l), condCode(co)
+	MoveBlock(Dest d, FlexSrc src, Flag co = NONE):
+		Instr(make(OP_MOV, co, d, -1, src))
 	{}
-	
-
+};
 
-	std::string format()
+//Any constant: MOV or MVN of an immediate where one fits, else a literal pool load
+struct ConstBlock: public Instr
+{
+	ConstBlock(Dest d, int32_t value):
+		Instr(make(OP_LDRCONST, NONE, d, -1, Imm(value)))
 	{
-		std::string out = std::string("    B");
-		out += flagToStr(condCode) + " ";
-		
-		out += label;
-		return out;
+		if(encodable(value)) op = OP_MOV;
+		else if(encodable(~value)){
+			op = OP_MVN;
+			imm = ~value;
+		}
 	}
-
 };
 
-class CMPBlock: public CodeBlock
+struct BranchBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
+	BranchBlock(Label l, Flag co = NONE):
+		Instr(make(OP_B, co, -1, -1, Imm(l)))
+	{}
+};
 
-public:
+struct CMPBlock: public Instr
+{
 	CMPBlock(Src a, FlexSrc b):
-		op1(a),op2(b)
+		Instr(make(OP_CMP, NONE, -1, a.value, b))
 	{}
-
-	std::string format()
-	{
-		std::string out = std::string("    CMP ") + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}
-
 };
 
-class AndBlock: public RegisterResultBlock
+struct AndBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
-public:
 	AndBlock(Dest d, Src p1, FlexSrc p2):
-		RegisterResultBlock(d), op1(p1), op2(p2)
+		Instr(make(OP_AND, NONE, d, p1.value, p2))
 	{}
-	std::string format()
-	{
-		std::string out = std::string("    AND ") + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}
 };
 
-class OrBlock: public RegisterResultBlock
+struct OrBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
-public:
-	OrBlock(int d, Src p1, FlexSrc p2):
-		RegisterResultBlock(d), op1(p1), op2(p2)
+	OrBlock(Dest d, Src p1, FlexSrc p2):
+		Instr(make(OP_ORR, NONE, d, p1.value, p2))
 	{}
-	std::string format()
-	{
-		std::string out = std::string("    OR ") + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}
 };
 
-class AddBlock: public RegisterResultBlock
+struct AddBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
-
-public:
 	AddBlock(Dest d, Src _0, FlexSrc _1):
-		RegisterResultBlock(d), op1(_0), op2(_1)
+		Instr(make(OP_ADD, NONE, d, _0.value, _1))
 	{}
-
-	void setOp2(FlexSrc i){
-		op2 = i;
-	}
-
-	std::string format()
-	{
-		if(op2.imm && op2.value == 0 && regD == op1.value)
-		{
-			throw CodeAbortException();
-		}
-		std::string out = std::string("    ADD r") + std::to_string((long long)regD) + ", " + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}	
 };
 
-class SubBlock: public RegisterResultBlock
+struct SubBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
-
-public:
 	SubBlock(Dest d, Src _0, FlexSrc _1):
-		RegisterResultBlock(d), op1(_0), op2(_1)
+		Instr(make(OP_SUB, NONE, d, _0.value, _1))
 	{}
-
-	void setOp2(FlexSrc i){
-		op2 = i;
-	}
-
-	std::string format()
-	{
-		std::string out = std::string("    SUB r") + std::to_string((long long)regD) + ", " + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}	
 };
 
-class RSBBlock: public RegisterResultBlock
+struct RSBBlock: public Instr
 {
-	Src op1;
-	FlexSrc op2;
-
-public:
 	RSBBlock(Dest d, Src _0, FlexSrc _1):
-		RegisterResultBlock(d), op1(_0), op2(_1)
+		Instr(make(OP_RSB, NONE, d, _0.value, _1))
 	{}
-
-	void setOp2(FlexSrc i){
-		op2 = i;
-	}
-
-	std::string format()
-	{
-		std::string out = std::string("    RSB r") + std::to_string((long long)regD) + ", " + op1.render();
-		out += ", ";
-		out += op2.render();
-		return out;
-	}	
 };
 
-class StackPushPop: public CodeBlock
+struct MulBlock: public Instr
 {
-	bool push;
-	std::vector<int64_t> loc;
-	
-	public:
-	StackPushPop(std::vector<int64_t> l, bool p):
-		push(p), loc(l)
+	MulBlock(Dest d, Src _0, Src _1):
+		Instr(make(OP_MUL, NONE, d, _0.value, FlexSrc(_1.value)))
 	{}
-	
-	std::string format()
+};
+
+//d = _0 * _1 + acc
+struct MlaBlock: public Instr
+{
+	MlaBlock(Dest d, Src _0, Src _1, Src acc):
+		Instr(make(OP_MLA, NONE, d, _0.value, FlexSrc(_1.value)))
 	{
-		if (loc.size()==0)throw CodeAbortException();
-		
-		std::string out = "";
-		if(push) out += std::string("    STMFD sp!, {r");
-		else out += std::string("    LDMFD sp!, {r");
-		
-		out += std::to_string((long long)loc[0]);
-		
-		for(size_t i=1; i<loc.size(); i++)
-		{
-			out += ", r" + std::to_string((long long)loc[i]);
-		}
-		out += "}";
-		return out;
+		imm = acc.value;
 	}
 };
 
-class StackOp: public CodeBlock
+//op d, _0, _1, LSL #shift, with _0 -1 for MOV
+struct ShiftedBlock: public Instr
 {
-	bool push;
-	int reg;
-	int offset;
-
-public:
-	StackOp(bool p, int r, int o):
-		push(p), reg(r), offset(o)
-	{}
-
-	std::string format()
+	ShiftedBlock(Opcode op, Dest d, Src _0, Src _1, int shift):
+		Instr(make(op, NONE, d, _0.value, FlexSrc(_1.value)))
 	{
-		std::string out = "";
-		if(push) out += std::string("    STR r");
-		else out += std::string("    LDR r");
-		out += std::to_string((long long)reg) + ", [fp, #" + std::to_string((long long)offset) + "]";
-		return out;
+		imm = shift;
 	}
-
 };
 
-class LabelBlock: public CodeBlock
+struct StackPushPop: public Instr
 {
-	std::string label;
-
-public:
-	LabelBlock(int i){
-		label = std::to_string((long long)i);
-	}
-	
-	LabelBlock(std::string s):
-		label(s)
-	{}
-	
-	std::string format()
+	StackPushPop(std::initializer_list<int> l, bool push):
+		Instr(make(push ? OP_PUSH : OP_POP, NONE, -1, -1, Imm(0)))
 	{
-		return label + ":";
+		for(int r: l) regList |= 1 << r;
 	}
+};
 
+struct StackOp: public Instr
+{
+	StackOp(bool push, int reg, int offset):
+		Instr(make(push ? OP_STR : OP_LDR, NONE, reg, 11, Imm(offset)))
+	{}
 };
 
-class BBlock: public CodeBlock
+struct LoadLabel: public Instr
 {
-	std::string label;
-	bool link;
-	
-public:
-	
-	BBlock(std::string s, bool l):
-		link(l)
-	{
-		label = s;
-	}
-	
-	BBlock(int s, bool l):
-		link(l)
-	{
-		label = "r" + std::to_string((long long) s);
-	}
-	
-	std::string format()
-	{
-		return std::string("    B") + (link?"L ":" ") + label;
-	}
+	LoadLabel(Dest d, Label l):
+		Instr(make(OP_LDRLIT, NONE, d, -1, Imm(l)))
+	{}
+};
 
+struct LabelBlock: public Instr
+{
+	LabelBlock(Label l):
+		Instr(make(OP_LABEL, NONE, -1, -1, Imm(l)))
+	{}
+};
 
+struct GlobalBlock: public Instr
+{
+	GlobalBlock(Label l):
+		Instr(make(OP_GLOBAL, NONE, -1, -1, Imm(l)))
+	{}
 };
 
-class TextBlock: public CodeBlock
+struct BBlock: public Instr
 {
-	std::string label;
-public:
-	TextBlock(std::string s):
-		label(s)
+	BBlock(Label l, bool link):
+		Instr(make(link ? OP_BL : OP_B, NONE, -1, -1, Imm(l)))
 	{}
-	
-	std::string format()
-	{
-		return label;
-	}
+};
 
+struct TextBlock: public Instr
+{
+	TextBlock(std::string s);
 };
 
 class CodeGen
 {
-	static std::vector<CodeBlock*> blocks;
-	
 	public:
-		static void push(CodeBlock* p);
-		static void pushBegin(CodeBlock* p);
-
-		static void format(std::ostream& output){
-			
-			for(size_t i=0; i<blocks.size(); i++){
-				try{
-					output << blocks[i]->format() << "\n";
-				}
-				catch (CodeAbortException e)
-				{}
-			}
+		//Generated code of the active compilation
+		struct State
+		{
+			std::vector<Instr> instrs;
+			std::vector<std::string> text;
+		};
+
+	private:
+		static State& state();
+
+	public:
+		static size_t push(const Instr& i);
+		static void pushBegin(const Instr& i);
+
+		//Before pushing the arguments of a call with args of them that don't
+		//fit in r0-r3
+		static void alignArguments(int args);
+		//Calls callee with the first four of args in r0-r3 and the rest pushed
+		//in order, and drops those again once it returns
+		static void call(Label callee, int args);
+		//Branches to callee with args in r0-r3 for it to return straight to
+		//the caller; Frame leaves the frame in front of the branch
+		static void tailCall(Label callee, int args);
+		static int addText(std::string s);
+
+		static Instr& at(size_t i){
+			return state().instrs[i];
 		}
 
-		static bool rebindResultReg(int r);
+		static size_t size(){
+			return state().instrs.size();
+		}
+
+		//The whole stream, for passes that rewrite it
+		static std::vector<Instr>& instructions(){
+			return state().instrs;
+		}
+
+		//Strings of TEXT instructions, by their imm
+		static const std::vector<std::string>& text(){
+			return state().text;
+		}
+
+		static void emit(AsmWriter& output);
 };
 
 #endif
-
@@ -0,0 +1,62 @@
+#include "Compilation.hpp"
+
+thread_local Compilation* Compilation::active = NULL;
+thread_local CodeBuffer* CodeBuffer::target = NULL;
+
+void CodeBuffer::append(CodeBuffer& f)
+{
+	Scope into(*this);
+
+	//Label numbers of f mapped to their numbers here
+	int base = labels.labelCount - 1;
+	labels.labelCount += f.labels.labelCount - 1;
+
+	std::vector<Label> named(f.labels.names.size());
+	for(size_t i=0; i<named.size(); i++){
+		named[i] = LabelAlloc::named(f.labels.names[i]);
+	}
+
+	//Literals are numbered by first use, so take f's in its own order
+	std::vector<const std::string*> byIndex(f.strings.stringMap.size());
+	for(auto it = f.strings.stringMap.begin(); it != f.strings.stringMap.end(); it++){
+		byIndex[it->second] = &it->first;
+	}
+	std::vector<Label> literals(byIndex.size());
+	for(size_t i=0; i<byIndex.size(); i++){
+		literals[i] = StringBin::intern(*byIndex[i]);
+	}
+
+	int textBase = code.text.size();
+	for(size_t i=0; i<f.code.text.size(); i++){
+		code.text.push_back(std::move(f.code.text[i]));
+	}
+
+	code.instrs.reserve(code.instrs.size() + f.code.instrs.size());
+	for(size_t n=0; n<f.code.instrs.size(); n++){
+		Instr i = f.code.instrs[n];
+		switch(i.op){
+			case OP_TEXT:
+				i.imm += textBase;
+				break;
+			case OP_LDRLIT:
+			case OP_B:
+			case OP_BL:
+			case OP_LABEL:
+			case OP_GLOBAL:
+				switch(i.imm & LABEL_KIND_MASK){
+					case LABEL_LOCAL: i.imm = LABEL_LOCAL | (LabelAlloc::number(i.imm) + base); break;
+					case LABEL_LITERAL: i.imm = literals[LabelAlloc::number(i.imm)]; break;
+					default: i.imm = named[i.imm];
+				}
+				break;
+		}
+		code.instrs.push_back(i);
+	}
+
+	for(int c=0; c<COUNT_COUNT; c++){
+		counts[c] += f.counts[c];
+	}
+
+	f.code.instrs.clear();
+	f.code.text.clear();
+}
@@ -0,0 +1,120 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <cassert>
+#include <unordered_map>
+#include "Arena.hpp"
+#include "Symbol.h"
+#include "Tree.h"
+#include "CodeGen.hpp"
+#include "LabelAlloc.hpp"
+#include "Allocation.hpp"
+#include "KnownValues.hpp"
+#include "Stats.hpp"
+
+class TranslationUnit;
+class FuncDef;
+class ThreadPool;
+
+/*
+Generated code and the state used to produce it. A unit has one; when
+functions are generated in parallel each gets a buffer of its own, and the
+buffers are appended to the unit's in source order afterwards.
+*/
+struct CodeBuffer
+{
+	CodeGen::State code;
+	LabelAlloc::State labels;
+	LoopLabelJump::State loops;
+	RegAlloc::State regs;
+	StackStore::State stack;
+	StringBin::State strings;
+	KnownValues::State known;
+
+	uint64_t counts[COUNT_COUNT] = {};	//For --stats
+
+	//Moves the code of f to the end of this buffer, renumbering its labels,
+	//literals and text as if it had been generated here
+	void append(CodeBuffer& f);
+
+	static CodeBuffer& current()
+	{
+		assert(target != NULL);
+		return *target;
+	}
+
+	//Directs code generation on this thread into a buffer for the lifetime of the Scope
+	class Scope
+	{
+		CodeBuffer* previous;
+	public:
+		Scope(CodeBuffer& b):
+			previous(target)
+		{
+			target = &b;
+		}
+		~Scope()
+		{
+			target = previous;
+		}
+	};
+
+private:
+	static thread_local CodeBuffer* target;
+};
+
+/*
+Everything the compiler keeps while translating one source file.
+CodeGen, RegAlloc, LabelAlloc and the other static facades find their data
+through the Compilation made active on the calling thread, so separate files
+can be compiled on separate threads without sharing any state.
+*/
+class Compilation
+{
+	static thread_local Compilation* active;
+
+public:
+	Arena arena;	//Declared first, so it is destroyed after everything below
+
+	SymbolTable::State symbols;
+	ScopeTable::State scopes;
+	TranslationUnit* tu = NULL;
+	std::unordered_map<SymbolId, FuncDef*> functions;	//Defined in the unit, by name
+
+	CodeBuffer code;
+	ThreadPool* pool = NULL;	//Used for per-function code generation if set
+	PhaseTime times[PHASE_COUNT];	//For --time-report
+
+	Compilation() = default;
+	Compilation(const Compilation&) = delete;
+	Compilation& operator=(const Compilation&) = delete;
+
+	static Compilation& current()
+	{
+		assert(active != NULL);
+		return *active;
+	}
+
+	/*
+	Makes a compilation (its arena and code buffer) the one used by this
+	thread for the lifetime of the Scope
+	*/
+	class Scope
+	{
+		Compilation* previous;
+		Arena::Scope useArena;
+		CodeBuffer::Scope useCode;
+	public:
+		Scope(Compilation& c):
+			previous(active), useArena(c.arena), useCode(c.code)
+		{
+			active = &c;
+		}
+		~Scope()
+		{
+			active = previous;
+		}
+	};
+};
+
+#endif
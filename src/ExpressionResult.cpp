@@ -11,22 +11,22 @@ Registerable* ExpressionResultHolder::getRegisterable(){
 RegExpressionResult FlagsResult::toRegisterable(){
     auto tempval = TemporaryValue::create();
     int reg = tempval->getReg();
-    CodeGen::push(new MoveBlock(reg, FlexSrc(0, true)));
-    CodeGen::push(new MoveBlock(reg, FlexSrc(1, true), flag));
+    CodeGen::push(MoveBlock(reg, FlexSrc(0, true)));
+    CodeGen::push(MoveBlock(reg, FlexSrc(1, true), flag));
     return std::make_shared<TempResult>(tempval);
 }
 
 RegExpressionResult LiteralResult::toRegisterable(){
     auto tempval = TemporaryValue::create();
     int reg = tempval->getReg();
-    CodeGen::push(new TextBlock("    LDR r" + std::to_string(reg) + ", =" + literal));
+    CodeGen::push(LoadLabel(reg, literal));
     return std::make_shared<TempResult>(tempval);
 }
 
 RegExpressionResult ConstResult::toRegisterable(){
     auto tempval = TemporaryValue::create();
     int reg = tempval->getReg();
-    CodeGen::push(new MoveBlock(reg, FlexSrc(value, true)));
+    CodeGen::push(ConstBlock(reg, value));
     return std::make_shared<TempResult>(tempval);
 }
 
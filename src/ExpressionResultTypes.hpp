@@ -1,5 +1,6 @@
 
 #include "ExpressionResultBase.hpp"
+#include "LabelAlloc.hpp"
 
 
 class FlagsResult: public ExpressionResultHolder{
@@ -18,15 +19,16 @@ class FlagsResult: public ExpressionResultHolder{
 };
 
 class LiteralResult: public ExpressionResultHolder{
-	std::string literal;
+	Label literal;
 
 	public:
-	LiteralResult(std::string l):
+	LiteralResult(Label l):
 		ExpressionResultHolder(LITERAL),
 		literal(l)
 	{}
 
 	int getValue(){throw CompilerError("Literal cannot be used directly");}
+	Label getLabel(){return literal;}
 
 	RegExpressionResult toRegisterable();
 };
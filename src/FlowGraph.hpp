@@ -0,0 +1,169 @@
+#ifndef FLOWGRAPH_H
+#define FLOWGRAPH_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <algorithm>
+
+/*
+Dominators and natural loops of a control flow graph, for any vector of
+blocks that each have succ and pred lists of block indices, such as the
+blocks of Cfg or of an IrFunction. Block 0 is the entry.
+*/
+template<typename Block>
+class FlowGraph
+{
+public:
+	struct Loop
+	{
+		int header;
+		size_t size;		//Blocks in it, including those of nested loops
+		std::vector<bool> in;	//By block
+		int parent = -1;	//Enclosing loop
+		int depth = 1;		//1 for outermost loops
+		std::vector<int> children;
+		std::vector<int> exits;	//Blocks outside it with a predecessor inside it, sorted
+	};
+
+	//The blocks reachable from the entry, in reverse postorder
+	static std::vector<int> reversePostorder(const std::vector<Block>& blocks);
+
+	//Immediate dominator of each block, -1 for the entry and unreachable
+	//blocks; order is from reversePostorder
+	static std::vector<int> dominators(const std::vector<Block>& blocks, const std::vector<int>& order);
+
+	//The natural loop of each header, innermost first, nested in a tree by
+	//containment
+	static std::vector<Loop> loops(const std::vector<Block>& blocks, const std::vector<int>& order, const std::vector<int>& idom);
+};
+
+template<typename Block>
+std::vector<int> FlowGraph<Block>::reversePostorder(const std::vector<Block>& blocks)
+{
+	std::vector<int> post;
+	std::vector<bool> seen(blocks.size(), false);
+	std::vector<std::pair<int, size_t> > stack(1, std::make_pair(0, 0));
+	seen[0] = true;
+	while(!stack.empty()){
+		int b = stack.back().first;
+		size_t& s = stack.back().second;
+		if(s == blocks[b].succ.size()){
+			post.push_back(b);
+			stack.pop_back();
+			continue;
+		}
+		int to = blocks[b].succ[s++];
+		if(seen[to]) continue;
+		seen[to] = true;
+		stack.push_back(std::make_pair(to, 0));
+	}
+	return std::vector<int>(post.rbegin(), post.rend());
+}
+
+/*
+Cooper, Harvey and Kennedy's iterative algorithm: each block's dominator is
+the closest common dominator of its processed predecessors, repeated in
+reverse postorder until nothing changes.
+*/
+template<typename Block>
+std::vector<int> FlowGraph<Block>::dominators(const std::vector<Block>& blocks, const std::vector<int>& order)
+{
+	std::vector<int> index(blocks.size(), -1);
+	for(size_t n=0; n<order.size(); n++) index[order[n]] = n;
+	std::vector<int> idom(blocks.size(), -1);
+	idom[0] = 0;
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(size_t n=1; n<order.size(); n++){
+			int b = order[n];
+			int dom = -1;
+			for(int p: blocks[b].pred){
+				if(idom[p] < 0) continue;
+				if(dom < 0){
+					dom = p;
+					continue;
+				}
+				int a = p;
+				while(a != dom){
+					while(index[a] > index[dom]) a = idom[a];
+					while(index[dom] > index[a]) dom = idom[dom];
+				}
+			}
+			if(dom != idom[b]){
+				idom[b] = dom;
+				changed = true;
+			}
+		}
+	}
+	idom[0] = -1;
+	return idom;
+}
+
+/*
+An edge to a block that dominates its source closes a loop; the loop is the
+header and every block that reaches the edge without going through it.
+Loops are sorted by size, so a loop comes before the loops around it. Two
+natural loops are either disjoint or one holds the other, so a loop's
+parent is the first loop after it that holds its header.
+*/
+template<typename Block>
+std::vector<typename FlowGraph<Block>::Loop> FlowGraph<Block>::loops(const std::vector<Block>& blocks, const std::vector<int>& order, const std::vector<int>& idom)
+{
+	std::vector<Loop> found;
+	for(int h: order){
+		std::vector<int> work;
+		for(int p: blocks[h].pred){
+			int d = p;
+			while(d >= 0 && d != h) d = idom[d];
+			if(d == h) work.push_back(p);
+		}
+		if(work.empty()) continue;
+
+		Loop l;
+		l.header = h;
+		l.size = 1;
+		l.in.assign(blocks.size(), false);
+		l.in[h] = true;
+		while(!work.empty()){
+			int b = work.back();
+			work.pop_back();
+			if(l.in[b]) continue;
+			l.in[b] = true;
+			l.size++;
+			for(int p: blocks[b].pred){
+				if(p == 0 || idom[p] >= 0) work.push_back(p);
+			}
+		}
+		found.push_back(std::move(l));
+	}
+	std::stable_sort(found.begin(), found.end(), [](const Loop& a, const Loop& b){
+		return a.size < b.size || (a.size == b.size && a.header < b.header);
+	});
+
+	for(size_t l=0; l<found.size(); l++){
+		Loop& loop = found[l];
+		for(size_t p=l+1; p<found.size(); p++){
+			if(found[p].in[loop.header]){
+				loop.parent = p;
+				found[p].children.push_back(l);
+				break;
+			}
+		}
+		for(int b: order){
+			if(!loop.in[b]) continue;
+			for(int s: blocks[b].succ){
+				if(!loop.in[s]) loop.exits.push_back(s);
+			}
+		}
+		std::sort(loop.exits.begin(), loop.exits.end());
+		loop.exits.erase(std::unique(loop.exits.begin(), loop.exits.end()), loop.exits.end());
+	}
+	for(size_t l=found.size(); l-- > 0;){
+		if(found[l].parent >= 0) found[l].depth = found[found[l].parent].depth + 1;
+	}
+	return found;
+}
+
+#endif
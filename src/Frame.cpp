@@ -0,0 +1,108 @@
+#include "Frame.hpp"
+#include "Allocation.hpp"
+#include "Stats.hpp"
+
+bool Frame::needsPointer(size_t from)
+{
+	const std::vector<Instr>& code = CodeGen::instructions();
+	for(size_t k=from; k<code.size(); k++){
+		if(code[k].op == OP_PUSH || code[k].op == OP_POP) return true;
+	}
+	return false;
+}
+
+bool Frame::mentions(const Instr& i, int reg)
+{
+	switch(i.op){
+		case OP_PUSH:
+		case OP_POP:
+			return i.regList >> reg & 1;
+		case OP_LDRLIT:
+		case OP_B:
+		case OP_BL:
+		case OP_LABEL:
+		case OP_GLOBAL:
+		case OP_TEXT:
+			return i.rd == reg;
+	}
+	return i.rd == reg || i.rn == reg || (!i.immOperand() && i.rm == reg) || (i.accumulates() && i.imm == reg);
+}
+
+//Moves sp by bytes, built in r12 first if no immediate holds it
+static void adjust(std::vector<Instr>& out, Opcode op, int bytes)
+{
+	FlexSrc amount = Imm(bytes);
+	if(!Instr::encodable(bytes)){
+		out.push_back(ConstBlock(12, bytes));
+		amount = FlexSrc(12);
+	}
+	out.push_back(Instr::make(op, NONE, 13, 13, amount));
+}
+
+/*
+Without fp a slot at fp - n is at sp + size - n, as sp stays size bytes
+below where fp would be from the prologue to the epilogue. Parameters
+passed on the stack are at fp + n, past the registers pushed between
+where sp was at the call and fp.
+*/
+void Frame::build(size_t body, Label ret, int size)
+{
+	std::vector<Instr>& code = CodeGen::instructions();
+	bool pointer = needsPointer(body);
+	uint16_t saved = pointer ? (1 << 11 | 1 << 14) : 0;
+	std::vector<size_t> passed;	//Accesses of parameters passed on the stack
+	for(size_t k=body; k<code.size(); k++){
+		Instr& i = code[k];
+		if(i.op == OP_BL) saved |= 1 << 14;
+		if((i.op == OP_STR || i.op == OP_LDR) && i.rn == 11){
+			if(i.imm >= 0) passed.push_back(k);
+			if(!pointer){
+				i.rn = 13;
+				i.imm += size;
+			}
+		}
+		//The caller keeps values in r4 and up across the call
+		for(int r=CALLER_SAVED; r<=11; r++){
+			if(mentions(i, r)) saved |= 1 << r;
+		}
+	}
+	//sp has to stay 8-byte aligned at calls, which r12 is pushed for if needed
+	if((saved & (1 << 14)) && (4 * __builtin_popcount(saved) + size) % 8) saved |= 1 << 12;
+	for(size_t k: passed) code[k].imm += 4 * __builtin_popcount(saved);
+
+	//Done before returning and before each tail call
+	std::vector<Instr> leave;
+	if(pointer) leave.push_back(AddBlock(13, 11, Imm(0)));
+	else if(size > 0) adjust(leave, OP_ADD, size);
+	if(saved){
+		Instr pop = StackPushPop({}, false);
+		pop.regList = saved;
+		leave.push_back(pop);
+	}
+
+	std::vector<Instr> rest(code.begin() + body, code.end());
+	code.resize(body);
+	if(saved){
+		Instr push = StackPushPop({}, true);
+		push.regList = saved;
+		code.push_back(push);
+	}
+	if(pointer) code.push_back(AddBlock(11, 13, Imm(0)));
+	if(size > 0) adjust(code, OP_SUB, size);
+
+	for(size_t k=0; k<rest.size(); k++){
+		const Instr& i = rest[k];
+		if(i.op == OP_B && LabelAlloc::isNamed(i.imm) && i.imm != ret){
+			code.insert(code.end(), leave.begin(), leave.end());
+		}
+		code.push_back(i);
+	}
+
+	//Returns by popping lr into pc where it was saved
+	code.insert(code.end(), leave.begin(), leave.end());
+	if(saved & (1 << 14)) code.back().regList ^= 1 << 14 | 1 << 15;
+	else code.push_back(MoveBlock(15, 14));
+
+	if(!saved && size == 0) Stats::count(COUNT_FRAMES_OMITTED);
+	else if(!pointer) Stats::count(COUNT_FP_OMITTED);
+}
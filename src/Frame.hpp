@@ -0,0 +1,36 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstddef>
+#include "CodeGen.hpp"
+
+/*
+Prologue and epilogue of a function, put around its body once it is
+allocated and the stack it needs is known. A body that pushes call
+arguments moves sp, so it keeps fp set up and addresses its stack slots
+from it. Any other addresses them from sp instead, which leaves r11 to
+LinearScan. Of r4-r11, which the caller keeps across the call, only those
+the body writes or reads are saved, and lr only if it makes calls; a
+function with no calls, no stack slots and only r0-r3 has no frame at all
+and returns with MOV pc, lr. A function that makes calls keeps sp 8-byte
+aligned for them as the AAPCS requires, pushing r12 as well when the rest
+of the frame is an odd number of words.
+
+Tail calls are generated as a bare branch to the callee, which gets the
+frame left in front of it here.
+*/
+class Frame
+{
+public:
+	//Whether the code from instruction from on moves sp itself
+	static bool needsPointer(size_t from);
+
+	//Frames the function whose body starts at instruction body and ends at
+	//ret, with size bytes of stack slots
+	static void build(size_t body, Label ret, int size);
+
+private:
+	static bool mentions(const Instr& i, int reg);
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include "InstrSelect.hpp"
+#include "Allocation.hpp"
+#include "Multiply.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+
+InstrSelect::InstrSelect(IrFunction& f):
+	fn(f), reg(f.values.size(), -1), shares(f.values.size(), -1), uses(f.values.size(), 0), label(f.blocks.size(), -1),
+	product(f.values.size(), -1), accumulated(f.values.size(), false)
+{
+	for(int b: fn.layout){
+		for(int v: fn.blocks[b].code){
+			for(int a: fn.values[v].args) uses[a]++;
+		}
+	}
+	fuseProducts();
+	coalesce();
+}
+
+//A multiply of two registers used once, by an add later in the same block
+void InstrSelect::fuseProducts()
+{
+	for(int b: fn.layout){
+		for(int v: fn.blocks[b].code){
+			const IrValue& i = fn.values[v];
+			if(i.op != IR_ADD) continue;
+			for(size_t a=0; a<2; a++){
+				int m = i.args[a];
+				const IrValue& mul = fn.values[m];
+				if(mul.op != IR_MUL || uses[m] != 1 || mul.block != b || fn.isConst(i.args[1 - a])) continue;
+				if(fn.isConst(mul.args[0]) || fn.isConst(mul.args[1])) continue;
+				product[v] = m;
+				accumulated[m] = true;
+				break;
+			}
+		}
+	}
+}
+
+void InstrSelect::coalesce()
+{
+	for(int b: fn.layout){
+		for(int p: fn.blocks[b].code){
+			const IrValue& phi = fn.values[p];
+			if(phi.op != IR_PHI) break;
+			for(size_t e=0; e<phi.args.size(); e++){
+				int v = phi.args[e];
+				uint8_t op = fn.values[v].op;
+				if(uses[v] != 1 || op == IR_CONST || op == IR_PHI || shares[v] >= 0) continue;
+				if(deadFrom(p, v, e)) shares[v] = p;
+			}
+		}
+	}
+}
+
+/*
+Whether nothing reads phi from where v is defined to where v is copied into
+it over edge. Only a straight run of blocks is followed, which is enough
+for the values carried round a loop, and as every other value sharing the
+register gets there by a run of its own, none of them can be live in it.
+*/
+bool InstrSelect::deadFrom(int phi, int v, size_t edge)
+{
+	int to = fn.values[phi].block;
+	int b = fn.values[v].block;
+	const std::vector<int>* code = &fn.blocks[b].code;
+	size_t k = std::find(code->begin(), code->end(), v) - code->begin() + 1;
+	for(int steps=0; ; steps++){
+		for(; k<code->size(); k++){
+			//A multiply and accumulate reads the multiply's operands too
+			int u = (*code)[k];
+			for(int w: {u, product[u]}){
+				if(w < 0) continue;
+				const std::vector<int>& args = fn.values[w].args;
+				if(std::find(args.begin(), args.end(), phi) != args.end()) return false;
+			}
+		}
+		const std::vector<int>& succ = fn.blocks[b].succ;
+		if(succ.size() != 1 || steps > 16) return false;
+		if(succ[0] == to) break;
+		b = succ[0];
+		code = &fn.blocks[b].code;
+		k = 0;
+	}
+	if(fn.blocks[to].pred[edge] != b) return false;
+
+	//The other phis are copied at the same time
+	for(int q: fn.blocks[to].code){
+		if(fn.values[q].op != IR_PHI) break;
+		if(fn.values[q].args[edge] == phi) return false;
+	}
+	return true;
+}
+
+/*
+Blocks go out in layout order, each ending in a branch to whichever of its
+successors it doesn't fall through to. Labels are worked out first, since a
+loop header is laid out before the branch back to it.
+*/
+void InstrSelect::lower(IrFunction& fn)
+{
+	fn.splitCriticalEdges();
+	InstrSelect pass(fn);
+	const std::vector<int>& layout = fn.layout;
+
+	for(size_t n=0; n<layout.size(); n++){
+		const IrBlock& block = fn.blocks[layout[n]];
+		int next = n + 1 < layout.size() ? layout[n+1] : -1;
+		if(block.succ.size() == 2){
+			if(block.succ[0] != next || block.succ[1] == next) pass.target(block.succ[0]);
+			if(block.succ[1] != next) pass.target(block.succ[1]);
+		}
+		else if(block.succ.size() == 1 && block.succ[0] != next) pass.target(block.succ[0]);
+	}
+
+	for(size_t n=0; n<layout.size(); n++){
+		int b = layout[n];
+		const IrBlock& block = fn.blocks[b];
+		if(pass.label[b] >= 0) CodeGen::push(LabelBlock(pass.label[b]));
+		for(size_t k=0; k+1<block.code.size(); k++) pass.select(block.code[k]);
+		if(block.succ.size() == 1) pass.copies(b, block.succ[0]);
+		pass.terminate(b, n + 1 < layout.size() ? layout[n+1] : -1);
+	}
+}
+
+Label InstrSelect::target(int b)
+{
+	if(label[b] < 0) label[b] = LabelAlloc::allocate();
+	return label[b];
+}
+
+int InstrSelect::regOf(int v)
+{
+	if(shares[v] >= 0) return regOf(shares[v]);
+	if(reg[v] < 0) reg[v] = RegAlloc::newVirtual();
+	return reg[v];
+}
+
+int InstrSelect::load(int v)
+{
+	if(!fn.isConst(v)) return regOf(v);
+	int r = RegAlloc::newVirtual();
+	CodeGen::push(ConstBlock(r, fn.values[v].imm));
+	return r;
+}
+
+FlexSrc InstrSelect::operand(int v)
+{
+	if(fn.isConst(v) && Instr::encodable(fn.values[v].imm)) return FlexSrc(Imm(fn.values[v].imm));
+	return FlexSrc(load(v));
+}
+
+bool InstrSelect::fused(int v)
+{
+	const IrValue& i = fn.values[v];
+	if(i.op != IR_CMP || uses[v] != 1) return false;
+	const IrValue& term = fn.values[fn.blocks[i.block].code.back()];
+	return term.op == IR_BRANCH && term.args[0] == v;
+}
+
+bool InstrSelect::tail(int v)
+{
+	const IrValue& i = fn.values[v];
+	if(i.op != IR_CALL || uses[v] != 1 || i.args.size() > 4) return false;
+	const std::vector<int>& code = fn.blocks[i.block].code;
+	const IrValue& term = fn.values[code.back()];
+	return term.op == IR_RETURN && term.args[0] == v && code[code.size() - 2] == v;
+}
+
+//The flag that holds with the operands the other way round
+static Flag reverse(Flag f)
+{
+	switch(f){
+		case GT: return LT;
+		case LT: return GT;
+		case GE: return LE;
+		case LE: return GE;
+		default: return f;
+	}
+}
+
+Flag InstrSelect::compare(int v)
+{
+	const IrValue& i = fn.values[v];
+	if(i.op != IR_CMP){
+		CodeGen::push(CMPBlock(load(v), Imm(0)));
+		return NE;
+	}
+	int a = i.args[0], b = i.args[1];
+	Flag f = (Flag)i.cond;
+	if(fn.isConst(a) && !fn.isConst(b)){
+		std::swap(a, b);
+		f = reverse(f);
+	}
+	CodeGen::push(CMPBlock(load(a), operand(b)));
+	return f;
+}
+
+void InstrSelect::select(int v)
+{
+	const IrValue& i = fn.values[v];
+	switch(i.op){
+		case IR_CONST:
+		case IR_PHI:
+			return;
+		case IR_PARAM:
+			if(i.imm < 4) CodeGen::push(MoveBlock(regOf(v), FlexSrc(i.imm)));
+			else CodeGen::push(StackOp(false, regOf(v), 4 * (i.imm - 4)));
+			return;
+		case IR_STRING:
+			CodeGen::push(LoadLabel(regOf(v), StringBin::newLiteral(fn.strings[i.imm])));
+			return;
+		case IR_CALL:
+		{
+			if(tail(v)) return;
+			//Past the fourth, pushed four at a time from r0-r3, the last ones first
+			size_t end = i.args.size();
+			CodeGen::alignArguments(end);
+			while(end > 4){
+				size_t from = end >= 8 ? end - 4 : 4;
+				for(size_t a=from; a<end; a++) CodeGen::push(MoveBlock(a - from, operand(i.args[a])));
+				Instr push = StackPushPop({}, true);
+				push.regList = (1 << (end - from)) - 1;
+				CodeGen::push(push);
+				end = from;
+			}
+			for(size_t a=0; a<end; a++) CodeGen::push(MoveBlock(a, operand(i.args[a])));
+			CodeGen::call(LabelAlloc::symbol(i.imm), i.args.size());
+			if(uses[v] > 0) CodeGen::push(MoveBlock(regOf(v), FlexSrc(0)));
+			return;
+		}
+		case IR_MUL:
+			multiply(v);
+			return;
+		case IR_CMP:
+		{
+			if(fused(v)) return;
+			Flag f = compare(v);
+			CodeGen::push(MoveBlock(regOf(v), Imm(0)));
+			CodeGen::push(MoveBlock(regOf(v), Imm(1), f));
+			return;
+		}
+	}
+
+	int a = i.args[0], b = i.args[1];
+	if(product[v] >= 0){
+		const IrValue& mul = fn.values[product[v]];
+		int acc = a == product[v] ? b : a;
+		CodeGen::push(MlaBlock(regOf(v), regOf(mul.args[0]), regOf(mul.args[1]), regOf(acc)));
+		return;
+	}
+	if(i.op == IR_SUB){
+		if(fn.isConst(a) && !fn.isConst(b)) CodeGen::push(RSBBlock(regOf(v), load(b), operand(a)));
+		else CodeGen::push(SubBlock(regOf(v), load(a), operand(b)));
+		return;
+	}
+	if(fn.isConst(a)) std::swap(a, b);
+	Opcode op = i.op == IR_ADD ? OP_ADD : i.op == IR_AND ? OP_AND : OP_ORR;
+	CodeGen::push(Instr::make(op, NONE, regOf(v), load(a), operand(b)));
+}
+
+//By shifts and adds where Multiply finds them cheaper than MUL
+void InstrSelect::multiply(int v)
+{
+	if(accumulated[v]) return;
+	const IrValue& i = fn.values[v];
+	int a = i.args[0], b = i.args[1];
+	if(fn.isConst(a)) std::swap(a, b);
+	if(!fn.isConst(b) || !Multiply::reducible(fn.values[b].imm)){
+		CodeGen::push(MulBlock(regOf(v), load(a), load(b)));
+		return;
+	}
+
+	//The steps read a after writing the result
+	int rd = regOf(v) == regOf(a) ? RegAlloc::newVirtual() : regOf(v);
+	Multiply::byConstant(rd, regOf(a), fn.values[b].imm);
+	if(rd != regOf(v)) CodeGen::push(MoveBlock(regOf(v), FlexSrc(rd)));
+}
+
+/*
+The phis of to take their arguments from the edge from from, all at once:
+a copy waits while its destination is still to be read by another, and
+when every one is waiting they form a cycle, broken with a spare register.
+*/
+void InstrSelect::copies(int from, int to)
+{
+	const IrBlock& block = fn.blocks[to];
+	size_t p = std::find(block.pred.begin(), block.pred.end(), from) - block.pred.begin();
+
+	std::vector<std::pair<int, int> > moves;
+	std::vector<std::pair<int, int32_t> > constants;
+	for(int v: block.code){
+		const IrValue& phi = fn.values[v];
+		if(phi.op != IR_PHI) break;
+		int src = phi.args[p];
+		if(fn.isConst(src)) constants.push_back(std::make_pair(regOf(v), fn.values[src].imm));
+		else if(regOf(src) != regOf(v)) moves.push_back(std::make_pair(regOf(v), regOf(src)));
+	}
+
+	while(!moves.empty()){
+		size_t m = 0;
+		for(; m<moves.size(); m++){
+			bool read = false;
+			for(size_t o=0; o<moves.size(); o++) read |= o != m && moves[o].second == moves[m].first;
+			if(!read) break;
+		}
+		if(m < moves.size()){
+			CodeGen::push(MoveBlock(moves[m].first, FlexSrc(moves[m].second)));
+			moves.erase(moves.begin() + m);
+			continue;
+		}
+		int saved = moves[0].first;
+		int spare = RegAlloc::newVirtual();
+		CodeGen::push(MoveBlock(spare, FlexSrc(saved)));
+		for(size_t o=0; o<moves.size(); o++){
+			if(moves[o].second == saved) moves[o].second = spare;
+		}
+	}
+	for(size_t c=0; c<constants.size(); c++){
+		CodeGen::push(ConstBlock(constants[c].first, constants[c].second));
+	}
+}
+
+void InstrSelect::terminate(int b, int next)
+{
+	const IrBlock& block = fn.blocks[b];
+	const IrValue& term = fn.values[block.code.back()];
+	switch(term.op){
+		case IR_RETURN:
+			if(!term.args.empty() && tail(term.args[0])){
+				const IrValue& call = fn.values[term.args[0]];
+				for(size_t a=0; a<call.args.size(); a++) CodeGen::push(MoveBlock(a, operand(call.args[a])));
+				CodeGen::tailCall(LabelAlloc::symbol(call.imm), call.args.size());
+				Stats::count(COUNT_TAIL_CALLS);
+				return;
+			}
+			if(!term.args.empty()) CodeGen::push(MoveBlock(0, operand(term.args[0])));
+			CodeGen::push(BBlock(LoopLabelJump::getReturn(), false));
+			return;
+		case IR_JUMP:
+			if(block.succ[0] != next) CodeGen::push(BBlock(target(block.succ[0]), false));
+			return;
+	}
+
+	Flag f = compare(term.args[0]);
+	int ifTrue = block.succ[0], ifFalse = block.succ[1];
+	if(ifTrue == next && ifFalse != next){
+		CodeGen::push(BranchBlock(target(ifFalse), flagInvert(f)));
+		return;
+	}
+	CodeGen::push(BranchBlock(target(ifTrue), f));
+	if(ifFalse != next) CodeGen::push(BBlock(target(ifFalse), false));
+}
@@ -0,0 +1,52 @@
+#ifndef INSTRSELECT_H
+#define INSTRSELECT_H
+
+#include <vector>
+#include <utility>
+#include "Ir.hpp"
+
+/*
+Lowers an IrFunction to instructions on virtual registers, for LinearScan
+to allocate. Constants become immediate operands where the instruction has
+one and are put in a register right where they are needed otherwise; a
+comparison only tested by the branch at the end of its block is done right
+before the branch, a product only added to another value in its block is done
+by MLA, a call whose result is returned right away
+leaves the frame and branches to the callee, and phis become copies at the end of each predecessor,
+which a value that only feeds the phi avoids by sharing its register.
+*/
+class InstrSelect
+{
+public:
+	static void lower(IrFunction& fn);
+
+private:
+	IrFunction& fn;
+	std::vector<int> reg;		//Virtual register of each value, -1 until it needs one
+	std::vector<int> shares;	//The phi whose register a value uses, or -1
+	std::vector<int> uses;
+	std::vector<Label> label;	//Of each block, -1 if nothing branches to it
+	std::vector<int> product;	//The multiplication an add accumulates onto, or -1
+	std::vector<bool> accumulated;	//Multiplications done by their add
+
+	InstrSelect(IrFunction& fn);
+
+	void coalesce();
+	void fuseProducts();
+	bool deadFrom(int phi, int v, size_t edge);
+
+	int regOf(int v);
+	int load(int v);	//A register holding v
+	FlexSrc operand(int v);
+	bool fused(int v);	//A comparison done by the branch that tests it
+	bool tail(int v);	//A call returned right away, done by the return
+	Flag compare(int v);	//Compares for a branch on v, returning the flag it is true on
+
+	void select(int v);
+	void multiply(int v);
+	void copies(int from, int to);
+	void terminate(int b, int next);
+	Label target(int b);
+};
+
+#endif
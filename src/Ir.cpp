@@ -0,0 +1,498 @@
+#include "Ir.hpp"
+#include "Stats.hpp"
+#include "Allocation.hpp"
+#include "FlowGraph.hpp"
+#include <algorithm>
+
+bool IrFunction::enabled = false;
+
+int IrFunction::add(int block, IrOp op, IrType type, std::vector<int> args, int32_t imm, Flag cond)
+{
+	IrValue v;
+	v.op = op;
+	v.type = type;
+	v.cond = cond;
+	v.imm = imm;
+	v.block = block;
+	v.args = std::move(args);
+	values.push_back(std::move(v));
+	forward.push_back(-1);
+
+	int id = values.size() - 1;
+	std::vector<int>& code = blocks[block].code;
+	if(op != IR_PHI){
+		code.push_back(id);
+		return id;
+	}
+	size_t k = 0;
+	while(k < code.size() && values[code[k]].op == IR_PHI) k++;
+	code.insert(code.begin() + k, id);
+	return id;
+}
+
+int IrFunction::newBlock()
+{
+	blocks.push_back(IrBlock());
+	return blocks.size() - 1;
+}
+
+int IrFunction::find(int v)
+{
+	int root = v;
+	while(forward[root] >= 0) root = forward[root];
+	while(forward[v] >= 0){
+		int next = forward[v];
+		forward[v] = root;
+		v = next;
+	}
+	return root;
+}
+
+void IrFunction::replace(int v, int with)
+{
+	with = find(with);
+	if(with == v) return;
+	forward[v] = with;
+	values[v].block = -1;
+}
+
+void IrFunction::addEdge(int from, int to)
+{
+	blocks[from].succ.push_back(to);
+	blocks[to].pred.push_back(from);
+}
+
+//Phis of to lose the argument that came in over the edge
+void IrFunction::removeEdge(int from, int to)
+{
+	std::vector<int>& succ = blocks[from].succ;
+	succ.erase(std::find(succ.begin(), succ.end(), to));
+
+	std::vector<int>& pred = blocks[to].pred;
+	auto it = std::find(pred.begin(), pred.end(), from);
+	size_t p = it - pred.begin();
+	pred.erase(it);
+	for(int v: blocks[to].code){
+		if(values[v].op != IR_PHI) break;
+		if(values[v].block >= 0) values[v].args.erase(values[v].args.begin() + p);
+	}
+}
+
+void IrFunction::compact()
+{
+	for(IrBlock& b: blocks){
+		size_t out = 0;
+		for(size_t k=0; k<b.code.size(); k++){
+			int v = b.code[k];
+			if(values[v].block < 0) continue;
+			for(int& a: values[v].args) a = find(a);
+			b.code[out++] = v;
+		}
+		b.code.resize(out);
+	}
+}
+
+/*
+A phi whose arguments are all one value, or itself, is that value. Taking
+one out can make others trivial, so this goes on until none are left.
+*/
+void IrFunction::simplifyPhis()
+{
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(IrBlock& b: blocks){
+			for(int v: b.code){
+				const IrValue& phi = values[v];
+				if(phi.op != IR_PHI) break;
+				if(phi.block < 0) continue;
+
+				int same = -1;
+				bool trivial = true;
+				for(int a: phi.args){
+					a = find(a);
+					if(a == v || a == same) continue;
+					if(same >= 0){
+						trivial = false;
+						break;
+					}
+					same = a;
+				}
+				if(!trivial || same < 0) continue;
+				replace(v, same);
+				changed = true;
+			}
+		}
+	}
+	compact();
+}
+
+enum Lattice
+{
+	UNKNOWN, CONSTANT, VARYING
+};
+
+static int32_t fold(const IrValue& v, int32_t a, int32_t b)
+{
+	switch(v.op){
+		case IR_ADD: return (int32_t)((uint32_t)a + (uint32_t)b);
+		case IR_SUB: return (int32_t)((uint32_t)a - (uint32_t)b);
+		case IR_AND: return a & b;
+		case IR_OR: return a | b;
+		case IR_MUL: return (int32_t)((uint32_t)a * (uint32_t)b);
+	}
+	switch(v.cond){
+		case EQ: return a == b;
+		case NE: return a != b;
+		case GT: return a > b;
+		case LT: return a < b;
+		case GE: return a >= b;
+		case LE: return a <= b;
+	}
+	assert(false);
+	return 0;
+}
+
+/*
+Wegman and Zadeck's sparse conditional constant propagation. Every value
+starts out unknown and can only move on to a constant and then to varying.
+A block is only looked at once an edge into it is taken, so a constant that
+decides a branch also keeps the values on the other side out of the phis.
+*/
+struct Sccp
+{
+	IrFunction& fn;
+	std::vector<uint8_t> state;
+	std::vector<int32_t> constant;
+	std::vector<std::vector<int> > users;
+	std::vector<bool> reached;
+	std::vector<std::vector<bool> > taken;	//Of each block, by predecessor
+	std::vector<int> edges;		//Blocks with a newly taken edge into them
+	std::vector<int> changed;	//Values whose state moved
+
+	Sccp(IrFunction& f):
+		fn(f), state(f.values.size(), UNKNOWN), constant(f.values.size(), 0), users(f.values.size()),
+		reached(f.blocks.size(), false), taken(f.blocks.size())
+	{
+		for(size_t b=0; b<fn.blocks.size(); b++){
+			taken[b].assign(fn.blocks[b].pred.size(), false);
+			for(int v: fn.blocks[b].code){
+				for(int a: fn.values[v].args) users[a].push_back(v);
+			}
+		}
+	}
+
+	void set(int v, Lattice s, int32_t c = 0)
+	{
+		if(s <= state[v]) return;
+		state[v] = s;
+		constant[v] = c;
+		changed.push_back(v);
+	}
+
+	void take(int from, int to)
+	{
+		const std::vector<int>& pred = fn.blocks[to].pred;
+		for(size_t p=0; p<pred.size(); p++){
+			if(pred[p] != from || taken[to][p]) continue;
+			taken[to][p] = true;
+			edges.push_back(to);
+		}
+	}
+
+	void visitPhi(int v)
+	{
+		const IrValue& phi = fn.values[v];
+		Lattice s = UNKNOWN;
+		int32_t c = 0;
+		for(size_t a=0; a<phi.args.size(); a++){
+			int arg = phi.args[a];
+			if(!taken[phi.block][a] || state[arg] == UNKNOWN) continue;
+			if(state[arg] == VARYING || (s == CONSTANT && constant[arg] != c)){
+				s = VARYING;
+				break;
+			}
+			s = CONSTANT;
+			c = constant[arg];
+		}
+		set(v, s, c);
+	}
+
+	void visit(int v)
+	{
+		const IrValue& i = fn.values[v];
+		const std::vector<int>& succ = fn.blocks[i.block].succ;
+		switch(i.op){
+			case IR_CONST:
+				set(v, CONSTANT, i.imm);
+				return;
+			case IR_PARAM:
+			case IR_STRING:
+			case IR_CALL:
+				set(v, VARYING);
+				return;
+			case IR_PHI:
+				visitPhi(v);
+				return;
+			case IR_JUMP:
+				take(i.block, succ[0]);
+				return;
+			case IR_BRANCH:
+			{
+				int c = i.args[0];
+				if(state[c] == VARYING || (state[c] == CONSTANT && constant[c] != 0)) take(i.block, succ[0]);
+				if(state[c] == VARYING || (state[c] == CONSTANT && constant[c] == 0)) take(i.block, succ[1]);
+				return;
+			}
+			case IR_RETURN:
+				return;
+		}
+
+		int a = i.args[0], b = i.args[1];
+		if(state[a] == VARYING || state[b] == VARYING) set(v, VARYING);
+		else if(state[a] == CONSTANT && state[b] == CONSTANT) set(v, CONSTANT, fold(i, constant[a], constant[b]));
+	}
+
+	void run()
+	{
+		reached[0] = true;
+		for(int v: fn.blocks[0].code) visit(v);
+
+		while(!edges.empty() || !changed.empty()){
+			while(!edges.empty()){
+				int b = edges.back();
+				edges.pop_back();
+				bool first = !reached[b];
+				reached[b] = true;
+				for(int v: fn.blocks[b].code){
+					if(!first && fn.values[v].op != IR_PHI) break;
+					visit(v);
+				}
+			}
+			while(!changed.empty()){
+				int v = changed.back();
+				changed.pop_back();
+				for(int u: users[v]){
+					if(reached[fn.values[u].block]) visit(u);
+				}
+			}
+		}
+	}
+};
+
+/*
+Values found to be constant become constants, branches on them become
+jumps, and blocks no taken edge leads to are removed along with their edges.
+*/
+void IrFunction::propagateConstants()
+{
+	Sccp sccp(*this);
+	sccp.run();
+
+	for(size_t b=0; b<blocks.size(); b++){
+		if(!blocks[b].live || !sccp.reached[b]) continue;
+		for(int v: blocks[b].code){
+			IrValue& i = values[v];
+			if(sccp.state[v] == CONSTANT && i.op == IR_PHI){
+				//Phis stay at the top of their block, so this one makes way for
+				//a constant at the top of the entry block
+				replace(v, add(0, IR_CONST, IR_INT, std::vector<int>(), sccp.constant[v]));
+				std::vector<int>& entry = blocks[0].code;
+				std::rotate(entry.begin(), entry.end() - 1, entry.end());
+				Stats::count(COUNT_SCCP_CONSTANTS);
+				continue;
+			}
+			if(sccp.state[v] == CONSTANT && i.op != IR_CONST){
+				i.op = IR_CONST;
+				i.type = IR_INT;
+				i.imm = sccp.constant[v];
+				i.args.clear();
+				Stats::count(COUNT_SCCP_CONSTANTS);
+			}
+			if(i.op == IR_BRANCH && sccp.state[i.args[0]] == CONSTANT){
+				int drop = blocks[b].succ[sccp.constant[i.args[0]] != 0 ? 1 : 0];
+				i.op = IR_JUMP;
+				i.args.clear();
+				removeEdge(b, drop);
+				Stats::count(COUNT_SCCP_BRANCHES);
+			}
+		}
+	}
+
+	for(size_t b=0; b<blocks.size(); b++){
+		IrBlock& block = blocks[b];
+		if(!block.live || sccp.reached[b]) continue;
+		while(!block.succ.empty()) removeEdge(b, block.succ.back());
+		for(int v: block.code) values[v].block = -1;
+		block.code.clear();
+		block.live = false;
+	}
+	layout.erase(std::remove_if(layout.begin(), layout.end(), [this](int b){return !blocks[b].live;}), layout.end());
+
+	simplifyPhis();
+}
+
+//Anything that neither has an effect nor feeds something that does
+void IrFunction::removeDeadCode()
+{
+	std::vector<bool> needed(values.size(), false);
+	std::vector<int> work;
+	for(const IrBlock& b: blocks){
+		for(int v: b.code){
+			uint8_t op = values[v].op;
+			if(op == IR_CALL || op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN){
+				needed[v] = true;
+				work.push_back(v);
+			}
+		}
+	}
+	while(!work.empty()){
+		int v = work.back();
+		work.pop_back();
+		for(int a: values[v].args){
+			a = find(a);
+			if(needed[a]) continue;
+			needed[a] = true;
+			work.push_back(a);
+		}
+	}
+
+	for(const IrBlock& b: blocks){
+		for(int v: b.code){
+			if(values[v].block < 0 || needed[v]) continue;
+			values[v].block = -1;
+			Stats::count(COUNT_DCE_REMOVED);
+		}
+	}
+	compact();
+}
+
+/*
+Moves computations whose operands don't change in a loop to the block that
+enters it, innermost loops first so a value can move out of several. Each
+hoisted value holds a register for the whole loop, so values are only
+hoisted while the ones already live across it stay within LOOP_PINNED,
+which calls in the loop leave in r4 and up.
+*/
+void IrFunction::hoistInvariants()
+{
+	std::vector<int> order = FlowGraph<IrBlock>::reversePostorder(blocks);
+	std::vector<int> idom = FlowGraph<IrBlock>::dominators(blocks, order);
+
+	//Uses other than by a branch, which tests a comparison where it is
+	std::vector<int> plainUses(values.size(), 0);
+	for(int b: order){
+		for(int v: blocks[b].code){
+			if(values[v].op == IR_BRANCH) continue;
+			for(int a: values[v].args) plainUses[a]++;
+		}
+	}
+
+	for(const FlowGraph<IrBlock>::Loop& l: FlowGraph<IrBlock>::loops(blocks, order, idom)){
+		hoistFrom(l.header, l.in, order, plainUses);
+	}
+}
+
+void IrFunction::hoistFrom(int header, const std::vector<bool>& in, const std::vector<int>& order, const std::vector<int>& plainUses)
+{
+	//A single way in from outside, going nowhere else
+	int pre = -1;
+	for(int p: blocks[header].pred){
+		if(in[p]) continue;
+		if(pre >= 0) return;
+		pre = p;
+	}
+	if(pre < 0 || blocks[pre].succ.size() != 1) return;
+
+	//Uses inside the loop, where the header's phis only use what comes round
+	//the back edges
+	std::vector<int> uses(values.size(), 0);
+	for(int b: order){
+		if(!in[b]) continue;
+		for(int v: blocks[b].code){
+			const IrValue& i = values[v];
+			for(size_t a=0; a<i.args.size(); a++){
+				if(b != header || i.op != IR_PHI || in[blocks[b].pred[a]]) uses[i.args[a]]++;
+			}
+		}
+	}
+
+	//Values held across the loop: the header's phis and values from outside
+	//it used inside, which a hoisted value joins and its operands may leave
+	std::vector<bool> outside(values.size(), false);
+	size_t pressure = 0;
+	for(size_t v=0; v<values.size(); v++){
+		if(values[v].block < 0 || isConst(v)) continue;
+		outside[v] = !in[values[v].block];
+		bool held = outside[v] ? uses[v] > 0 : values[v].op == IR_PHI && values[v].block == header;
+		pressure += held;
+	}
+
+	std::vector<int> hoisted;
+	for(int b: order){
+		if(!in[b]) continue;
+		for(int v: blocks[b].code){
+			const IrValue& i = values[v];
+			bool pure = i.op == IR_ADD || i.op == IR_SUB || i.op == IR_AND || i.op == IR_OR || i.op == IR_MUL || i.op == IR_STRING;
+			if(!pure && !(i.op == IR_CMP && plainUses[v] > 0)) continue;
+
+			bool invariant = true;
+			size_t freed = 0;
+			for(int a: i.args){
+				invariant &= outside[a] || isConst(a);
+				freed += outside[a] && !isConst(a) && uses[a] == 1;
+			}
+			size_t after = pressure + (uses[v] > 0) - freed;
+			if(!invariant || after > LOOP_PINNED) continue;
+
+			for(int a: i.args) uses[a]--;
+			outside[v] = true;
+			pressure = after;
+			hoisted.push_back(v);
+		}
+	}
+	if(hoisted.empty()) return;
+
+	for(int v: hoisted){
+		std::vector<int>& code = blocks[values[v].block].code;
+		code.erase(std::find(code.begin(), code.end(), v));
+		std::vector<int>& to = blocks[pre].code;
+		to.insert(to.end() - 1, v);
+		values[v].block = pre;
+	}
+	Stats::count(COUNT_LICM_HOISTED, hoisted.size());
+}
+
+void IrFunction::optimize()
+{
+	simplifyPhis();
+	propagateConstants();
+	removeDeadCode();
+	hoistInvariants();
+}
+
+/*
+Copies for a phi go at the end of each predecessor, which is only right if
+the predecessor goes nowhere else. Edges from blocks with two successors get
+a block of their own, laid out after the block they come from.
+*/
+void IrFunction::splitCriticalEdges()
+{
+	for(size_t n=0; n<layout.size(); n++){
+		int b = layout[n];
+		for(size_t s=0; s<blocks[b].succ.size() && blocks[b].succ.size() > 1; s++){
+			int to = blocks[b].succ[s];
+			const std::vector<int>& code = blocks[to].code;
+			if(blocks[to].pred.size() < 2 || code.empty() || values[code[0]].op != IR_PHI) continue;
+
+			int mid = newBlock();
+			blocks[b].succ[s] = mid;
+			std::vector<int>& pred = blocks[to].pred;
+			*std::find(pred.begin(), pred.end(), b) = mid;
+			blocks[mid].pred.push_back(b);
+			blocks[mid].succ.push_back(to);
+			add(mid, IR_JUMP, IR_VOID);
+			layout.insert(layout.begin() + n + 1, mid);
+		}
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef IR_H
+#define IR_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "CodeGen.hpp"
+
+enum IrOp
+{
+	IR_CONST,	//imm
+	IR_PARAM,	//Argument imm on entry, in its register or on the stack past the fourth
+	IR_STRING,	//Address of the literal strings[imm]
+	IR_PHI,		//One argument per predecessor of its block, in the same order
+	IR_ADD, IR_SUB, IR_AND, IR_OR, IR_MUL,
+	IR_CMP,		//1 if args[0] cond args[1], else 0
+	IR_CALL,	//Of the function with SymbolId imm, arguments in r0-r3 and then on the stack
+	IR_JUMP,	//Terminators, the last value of every block
+	IR_BRANCH,	//To succ[0] if args[0] is non-zero, else to succ[1]
+	IR_RETURN	//Of args[0], if there is one
+};
+
+enum IrType
+{
+	IR_VOID,	//Terminators
+	IR_INT,
+	IR_BOOL		//0 or 1, what a comparison gives
+};
+
+//One SSA value, defined once by the instruction that computes it
+struct IrValue
+{
+	uint8_t op;
+	uint8_t type;
+	uint8_t cond;	//Flag of IR_CMP
+	int32_t imm;
+	int block;	//-1 once removed
+	std::vector<int> args;
+};
+
+struct IrBlock
+{
+	std::vector<int> code;	//Phis first and a terminator last
+	std::vector<int> pred;
+	std::vector<int> succ;
+	bool live = true;	//False once found unreachable
+};
+
+/*
+A function in SSA form, between the syntax tree and instruction selection.
+Variables have become values, with phis where control flow joins; values
+are numbered and refer to each other by number, so a value that turns out
+to equal another is forwarded to it rather than rewritten at every use.
+Blocks keep the order they were started in, which is the order they are
+laid out in.
+*/
+class IrFunction
+{
+public:
+	//-O: functions go through the IR when everything in them is supported
+	static bool enabled;
+
+	std::vector<IrValue> values;
+	std::vector<IrBlock> blocks;	//blocks[0] is the entry
+	std::vector<int> layout;	//Live blocks in code order
+	std::vector<std::string> strings;
+
+	int add(int block, IrOp op, IrType type, std::vector<int> args = std::vector<int>(), int32_t imm = 0, Flag cond = NONE);
+	int newBlock();
+	int find(int v);	//What v has been forwarded to
+	void replace(int v, int with);
+	bool isConst(int v){return values[v].op == IR_CONST;}
+
+	void addEdge(int from, int to);
+	void removeEdge(int from, int to);
+
+	//Passes, run in this order by optimize
+	void simplifyPhis();
+	void propagateConstants();
+	void removeDeadCode();
+	void hoistInvariants();
+	void optimize();
+
+	//Every edge into a block with phis comes from a block with one successor
+	void splitCriticalEdges();
+
+private:
+	std::vector<int> forward;	//-1, or the value this one was replaced by
+
+	void compact();		//Drops removed values and forwards all arguments
+	void hoistFrom(int header, const std::vector<bool>& in, const std::vector<int>& order, const std::vector<int>& plainUses);
+};
+
+#endif
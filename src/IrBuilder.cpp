@@ -0,0 +1,228 @@
+#include "IrBuilder.hpp"
+#include "Exception.h"
+#include "Stats.hpp"
+
+IrBuilder::IrBuilder(IrFunction& f, FuncDef* func, int b):
+	fn(f), current(0), open(true), function(func), top(-1), budget(b)
+{
+	start(newBlock());
+	seal(0);
+	undef = constant(0);
+}
+
+int IrBuilder::newBlock()
+{
+	defs.emplace_back();
+	incomplete.emplace_back();
+	sealed.push_back(false);
+	return fn.newBlock();
+}
+
+void IrBuilder::start(int b)
+{
+	current = b;
+	open = true;
+	fn.layout.push_back(b);
+}
+
+void IrBuilder::seal(int b)
+{
+	for(size_t n=0; n<incomplete[b].size(); n++){
+		fillPhi(incomplete[b][n].first, incomplete[b][n].second);
+	}
+	incomplete[b].clear();
+	sealed[b] = true;
+}
+
+int IrBuilder::here()
+{
+	if(!open){
+		start(newBlock());
+		seal(current);
+	}
+	return current;
+}
+
+int IrBuilder::add(IrOp op, IrType type, std::vector<int> args, int32_t imm, Flag cond)
+{
+	return fn.add(here(), op, type, std::move(args), imm, cond);
+}
+
+int IrBuilder::constant(int32_t c)
+{
+	return add(IR_CONST, IR_INT, std::vector<int>(), c);
+}
+
+int IrBuilder::string(const std::string& text)
+{
+	fn.strings.push_back(text);
+	return add(IR_STRING, IR_INT, std::vector<int>(), fn.strings.size() - 1);
+}
+
+void IrBuilder::jump(int to)
+{
+	int b = here();
+	fn.add(b, IR_JUMP, IR_VOID);
+	fn.addEdge(b, to);
+	open = false;
+}
+
+void IrBuilder::branch(int cond, int ifTrue, int ifFalse)
+{
+	int b = here();
+	fn.add(b, IR_BRANCH, IR_VOID, {cond});
+	fn.addEdge(b, ifTrue);
+	fn.addEdge(b, ifFalse);
+	open = false;
+}
+
+void IrBuilder::ret(int v)
+{
+	if(!inlined.empty()){
+		Inlined& call = inlined.back();
+		call.returned.push_back(v < 0 ? undef : v);
+		jump(call.exit);
+		return;
+	}
+	std::vector<int> args;
+	if(v >= 0) args.push_back(v);
+	add(IR_RETURN, IR_VOID, args);
+	open = false;
+}
+
+void IrBuilder::declare(ScopedVariable* var)
+{
+	locals.insert(var);
+}
+
+void IrBuilder::write(ScopedVariable* var, int v)
+{
+	if(!locals.count(var)) throw UnimplementedException("global variable");
+	defs[here()][var] = v;
+}
+
+int IrBuilder::read(ScopedVariable* var)
+{
+	if(!locals.count(var)) throw UnimplementedException("global variable");
+	return readIn(var, here());
+}
+
+int IrBuilder::readIn(ScopedVariable* var, int b)
+{
+	auto it = defs[b].find(var);
+	if(it != defs[b].end()) return fn.find(it->second);
+
+	const std::vector<int>& pred = fn.blocks[b].pred;
+	int v;
+	if(!sealed[b]){
+		v = fn.add(b, IR_PHI, IR_INT);
+		incomplete[b].push_back(std::make_pair(var, v));
+	}
+	else if(pred.empty()) v = undef;
+	else if(pred.size() == 1) v = readIn(var, pred[0]);
+	else{
+		//Written first, so a loop back to b finds the phi
+		v = fn.add(b, IR_PHI, IR_INT);
+		defs[b][var] = v;
+		fillPhi(var, v);
+	}
+	defs[b][var] = v;
+	return v;
+}
+
+void IrBuilder::fillPhi(ScopedVariable* var, int phi)
+{
+	int b = fn.values[phi].block;
+	std::vector<int> args;
+	for(size_t p=0; p<fn.blocks[b].pred.size(); p++){
+		args.push_back(readIn(var, fn.blocks[b].pred[p]));
+	}
+	fn.values[phi].args = args;
+}
+
+void IrBuilder::beginLoop(int breakTo, int continueTo)
+{
+	loops.push_back(std::make_pair(breakTo, continueTo));
+}
+
+void IrBuilder::endLoop()
+{
+	loops.pop_back();
+}
+
+int IrBuilder::breakTarget()
+{
+	if(loops.empty()) throw SyntaxError(": break outside of a loop");
+	return loops.back().first;
+}
+
+int IrBuilder::continueTarget()
+{
+	if(loops.empty()) throw SyntaxError(": continue outside of a loop");
+	return loops.back().second;
+}
+
+void IrBuilder::beginBody()
+{
+	top = newBlock();
+	jump(top);
+	start(top);
+}
+
+bool IrBuilder::recurses(FuncDef* callee)
+{
+	return callee == function && top >= 0 && inlined.empty();
+}
+
+void IrBuilder::recurse()
+{
+	jump(top);
+}
+
+bool IrBuilder::inlines(FuncDef* callee, int size, bool hinted, const std::vector<int>& args)
+{
+	if(callee == function || size > budget) return false;
+	for(const Inlined& call: inlined){
+		if(call.callee == callee) return false;
+	}
+	int limit = hinted ? INLINE_HINTED : INLINE_SIZE;
+	for(int a: args) limit += fn.isConst(fn.find(a)) ? INLINE_CONSTANT : 0;
+	return size <= limit;
+}
+
+void IrBuilder::beginInline(FuncDef* callee, int size)
+{
+	Inlined call;
+	call.callee = callee;
+	call.exit = newBlock();
+	call.loops.swap(loops);
+	inlined.push_back(std::move(call));
+	budget -= size;
+}
+
+int IrBuilder::endInline()
+{
+	if(open) ret();
+	Inlined call = std::move(inlined.back());
+	inlined.pop_back();
+	loops.swap(call.loops);
+
+	start(call.exit);
+	seal(call.exit);
+	Stats::count(COUNT_INLINED);
+	if(call.returned.empty()) return undef;
+	for(int v: call.returned){
+		if(v != call.returned[0]) return fn.add(call.exit, IR_PHI, IR_INT, call.returned);
+	}
+	return call.returned[0];
+}
+
+void IrBuilder::finish()
+{
+	if(open) ret();
+	if(top >= 0){
+		Stats::count(COUNT_TAIL_RECURSION, fn.blocks[top].pred.size() - 1);
+		seal(top);
+	}
+	fn.optimize();
+}
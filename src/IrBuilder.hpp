@@ -0,0 +1,105 @@
+#ifndef IRBUILDER_H
+#define IRBUILDER_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include "Ir.hpp"
+
+class ScopedVariable;
+class FuncDef;
+
+/*
+Builds a function's IR as its syntax tree is walked, in SSA form from the
+start (Braun et al.): reading a variable finds the last write to it in the
+block, or else asks the predecessors and puts a phi where they differ.
+Blocks that can still gain predecessors, loop headers before their back
+edges, get placeholder phis that are filled in once the block is sealed.
+
+Calls to small functions of the same unit can be built as the callee's body
+instead, its returns going to a block after it where a phi takes whichever
+value was returned. A function returning a call to itself sets its
+parameters again and jumps back to the top of its body instead, which is
+only sealed once the whole body is built.
+*/
+class IrBuilder
+{
+public:
+	static const int INLINE_SIZE = 24;	//Most IR values of a callee inlined without asking
+	static const int INLINE_HINTED = 96;	//For one declared inline
+	static const int INLINE_CONSTANT = 8;	//More for each constant argument, which may fold much of it
+	static const int INLINE_BUDGET = 512;	//Most values inlined into one function in all
+
+	//Builds function, inlining up to budget values of callees into it
+	IrBuilder(IrFunction& fn, FuncDef* function, int budget);
+
+	int newBlock();
+	void start(int b);	//Goes on in b, which comes next in the layout
+	void seal(int b);	//Once every edge into b is there
+
+	int add(IrOp op, IrType type, std::vector<int> args = std::vector<int>(), int32_t imm = 0, Flag cond = NONE);
+	int constant(int32_t c);
+	int string(const std::string& text);
+
+	//Terminators; anything after one is unreachable until the next start
+	void jump(int to);
+	void branch(int cond, int ifTrue, int ifFalse);
+	void ret(int v = -1);
+
+	//Only variables of the function itself are turned into values
+	void declare(ScopedVariable* var);
+	void write(ScopedVariable* var, int v);
+	int read(ScopedVariable* var);
+
+	//Where break and continue go in the loops being built
+	void beginLoop(int breakTo, int continueTo);
+	void endLoop();
+	int breakTarget();
+	int continueTarget();
+
+	//The top of the body, after the parameters are taken
+	void beginBody();
+	//Whether a call to callee that the function returns can loop back to it
+	bool recurses(FuncDef* callee);
+	void recurse();
+
+	//Whether a call with args to callee of the given size is worth inlining
+	bool inlines(FuncDef* callee, int size, bool hinted, const std::vector<int>& args);
+	//Around the callee's body; returns become jumps to after it
+	void beginInline(FuncDef* callee, int size);
+	int endInline();	//The value returned
+
+	//Returns from the end of the body and optimizes the function
+	void finish();
+
+private:
+	IrFunction& fn;
+	int current;
+	bool open;	//Whether current has no terminator yet
+	int undef;	//What variables hold before they are first written
+	std::vector<std::unordered_map<ScopedVariable*, int> > defs;	//Last write in each block
+	std::vector<std::vector<std::pair<ScopedVariable*, int> > > incomplete;	//Placeholder phis of each block
+	std::vector<bool> sealed;
+	std::unordered_set<ScopedVariable*> locals;
+	std::vector<std::pair<int, int> > loops;
+
+	struct Inlined
+	{
+		FuncDef* callee;
+		int exit;
+		std::vector<int> returned;	//By each edge into exit
+		std::vector<std::pair<int, int> > loops;	//Of the caller
+	};
+	FuncDef* function;
+	int top;
+	int budget;
+	std::vector<Inlined> inlined;	//Callees being built, innermost last
+
+	int here();	//The current block, or a new unreachable one after a terminator
+	int readIn(ScopedVariable* var, int b);
+	void fillPhi(ScopedVariable* var, int phi);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "KnownValues.hpp"
+
+void KnownValues::begin()
+{
+	state().values.clear();
+}
+
+bool KnownValues::find(ScopedVariable* v, int32_t& value)
+{
+	Values& values = state().values;
+	auto it = values.find(v);
+	if(it == values.end()) return false;
+	value = it->second;
+	return true;
+}
+
+void KnownValues::set(ScopedVariable* v, int32_t value)
+{
+	state().values[v] = value;
+}
+
+void KnownValues::forget(ScopedVariable* v)
+{
+	state().values.erase(v);
+}
+
+void KnownValues::join(const Values& other)
+{
+	Values& values = state().values;
+	for(auto it = values.begin(); it != values.end();){
+		auto found = other.find(it->first);
+		if(found == other.end() || found->second != it->second) it = values.erase(it);
+		else ++it;
+	}
+}
+
+/*
+Every path through the loop starts from what is known before it, less what
+it assigns, and only changes what it assigns; that holds at the top of
+every iteration and wherever the loop is left.
+*/
+LoopVariables KnownValues::enterLoop(const LoopVariables& vars)
+{
+	for(ScopedVariable* v: vars.written) forget(v);
+
+	LoopVariables kept;
+	kept.declared = vars.declared;
+	int32_t value;
+	for(ScopedVariable* v: vars.used){
+		if(!find(v, value)) kept.used.push_back(v);
+	}
+	return kept;
+}
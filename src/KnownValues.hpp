@@ -0,0 +1,48 @@
+#ifndef KNOWNVALUES_H
+#define KNOWNVALUES_H
+
+#include <unordered_map>
+#include <cstdint>
+#include "Tree.h"
+
+/*
+Constant propagation through the local variables of a function generated
+straight from its tree; -O does the same on the IR. A variable assigned a
+constant is known until it is assigned anything else, and reads of it are
+folded like a literal, so whatever depends on it folds as well, down to
+the arms of an if. Where paths meet it stays known only if it has the same
+value on each, and a loop forgets every variable it assigns before it is
+generated. The assignments themselves are still generated, for where the
+variable stops being known.
+*/
+class KnownValues
+{
+public:
+	typedef std::unordered_map<ScopedVariable*, int32_t> Values;
+
+	struct State
+	{
+		Values values;
+	};
+
+private:
+	static State& state();
+
+public:
+	static void begin();	//Of a function, where nothing is known yet
+
+	static bool find(ScopedVariable* v, int32_t& value);
+	static void set(ScopedVariable* v, int32_t value);
+	static void forget(ScopedVariable* v);
+
+	//Where paths split, and where another path with other joins this one
+	static Values snapshot(){return state().values;}
+	static void restore(const Values& values){state().values = values;}
+	static void join(const Values& other);
+
+	//Before the loop with vars; the variables it refers to that are still
+	//known are left out of what is returned, as they needn't be in registers
+	static LoopVariables enterLoop(const LoopVariables& vars);
+};
+
+#endif
@@ -1,40 +1,152 @@
+#ifndef LABELALLOC_H
+#define LABELALLOC_H
+
 #include <string>
 #include <vector>
+#include <map>
+#include <cstdint>
+#include "Symbol.h"
+
+/*
+Labels are small integers. The top bits give the kind of label, the rest is
+either a sequence number (.L<n>, .literal_<n>) or an index into the table of
+interned names (functions, return labels, external symbols).
+*/
+typedef int32_t Label;
+
+enum LabelKind
+{
+	LABEL_NAMED = 0,
+	LABEL_LOCAL = 1 << 28,
+	LABEL_LITERAL = 2 << 28,
+	LABEL_KIND_MASK = 3 << 28
+};
 
 class LabelAlloc
 {
-	static int labelCount;
-	
 public:
-	static std::string allocate(bool mode = true)
+	struct State
+	{
+		int labelCount = 1;
+		std::vector<std::string> names;
+		std::map<std::string, Label> nameIndex;
+		std::vector<Label> symbolLabels;	//Indexed by SymbolId, -1 if not named yet
+	};
+
+private:
+	static State& state();
+
+public:
+	static Label allocate()
+	{
+		return LABEL_LOCAL | state().labelCount++;
+	}
+
+	static Label literal(int index)
 	{
-		return (mode?std::string(".L"):"") + std::to_string((long long)labelCount++);
+		return LABEL_LITERAL | index;
 	}
-	
+
+	static Label named(const std::string& s)
+	{
+		State& st = state();
+		auto it = st.nameIndex.find(s);
+		if(it != st.nameIndex.end()) return it->second;
+
+		Label l = st.names.size();
+		st.names.push_back(s);
+		st.nameIndex[s] = l;
+		return l;
+	}
+
+	//Label named after an identifier, without going through the name map
+	static Label symbol(SymbolId id)
+	{
+		std::vector<Label>& symbolLabels = state().symbolLabels;
+		if((size_t)id >= symbolLabels.size()) symbolLabels.resize(SymbolTable::size(), -1);
+		Label& l = symbolLabels[id];
+		if(l < 0) l = named(SymbolTable::name(id));
+		return l;
+	}
+
+	static bool isNamed(Label l)
+	{
+		return (l & LABEL_KIND_MASK) == LABEL_NAMED;
+	}
+
+	//Sequence number of a .L or .literal label
+	static int number(Label l)
+	{
+		return l & ~LABEL_KIND_MASK;
+	}
+
+	static const std::string& namedString(Label l)
+	{
+		return state().names[l];
+	}
+
+	static std::string name(Label l)
+	{
+		switch(l & LABEL_KIND_MASK){
+			case LABEL_LOCAL: return ".L" + std::to_string((long long)(l & ~LABEL_KIND_MASK));
+			case LABEL_LITERAL: return ".literal_" + std::to_string((long long)(l & ~LABEL_KIND_MASK));
+			default: return state().names[l];
+		}
+	}
+
 };
 
 class LoopLabelJump
 {
-	static std::string _return;
-	static std::vector<std::string> _break;
-	static std::vector<std::string> _continue;
-	
 public:
-	static void push(std::string b, std::string c)
+	struct State
+	{
+		Label _return;
+		SymbolId _function;
+		Label _top;	//-1 until a tail call of the function to itself needs it
+		std::vector<Label> _break;
+		std::vector<Label> _continue;
+	};
+
+private:
+	static State& state();
+
+public:
+	static void push(Label b, Label c)
 	{
-		_break.push_back(b);
-		_continue.push_back(c);
+		State& s = state();
+		s._break.push_back(b);
+		s._continue.push_back(c);
 	}
 	static void pop()
 	{
-		_break.pop_back();
-		_continue.pop_back();
+		State& s = state();
+		s._break.pop_back();
+		s._continue.pop_back();
 	}
-	
-	static std::string getBreak(){return _break.back();}
-	static std::string getContinue(){return _continue.back();}
-	
-	static void setReturn(std::string s){_return = s;}
-	static std::string getReturn(){return _return;}
-	
+
+	static Label getBreak(){return state()._break.back();}
+	static Label getContinue(){return state()._continue.back();}
+
+	static void setReturn(Label l){state()._return = l;}
+	static Label getReturn(){return state()._return;}
+
+	//The function being generated, and the top of its body that a tail call
+	//of it to itself jumps back to
+	static void setFunction(SymbolId f)
+	{
+		state()._function = f;
+		state()._top = -1;
+	}
+	static SymbolId getFunction(){return state()._function;}
+	static Label getTop()
+	{
+		State& s = state();
+		if(s._top < 0) s._top = LabelAlloc::allocate();
+		return s._top;
+	}
+	static bool hasTop(){return state()._top >= 0;}
+
 };
+
+#endif
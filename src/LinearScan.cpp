@@ -0,0 +1,361 @@
+#include "LinearScan.hpp"
+#include "Refs.hpp"
+#include "Exception.h"
+#include "Stats.hpp"
+#include "Frame.hpp"
+#include <algorithm>
+
+static void setBit(std::vector<uint64_t>& s, size_t i)
+{
+	s[i >> 6] |= 1ull << (i & 63);
+}
+
+static bool testBit(const std::vector<uint64_t>& s, size_t i)
+{
+	return (s[i >> 6] >> (i & 63)) & 1;
+}
+
+LinearScan::LinearScan(size_t f):
+	code(CodeGen::instructions()), from(f), base(FIRST_VIRTUAL), spillTemps(INT_MAX), slots(NREGS),
+	registers(Frame::needsPointer(f) ? NREGS : NREGS + 1), cfg(code, f, f)
+{}
+
+void LinearScan::allocate(size_t from)
+{
+	if(from >= CodeGen::size()) return;
+
+	LinearScan pass(from);
+	for(;;){
+		pass.cfg = Cfg(pass.code, from, pass.code.size());
+		pass.numberVirtuals();
+		pass.liveness();
+		pass.buildIntervals();
+		if(pass.scan()) break;
+		pass.spill();
+	}
+	pass.assign();
+}
+
+//Finds the range of virtual registers the code uses
+void LinearScan::numberVirtuals()
+{
+	int low = INT_MAX, high = FIRST_VIRTUAL - 1;
+	for(size_t k=from; k<code.size(); k++){
+		Refs refs(code[k]);
+		for(int n=0; n<refs.nUses; n++){
+			if(refs.uses[n] >= FIRST_VIRTUAL){
+				low = std::min(low, refs.uses[n]);
+				high = std::max(high, refs.uses[n]);
+			}
+		}
+		for(int n=0; n<refs.nDefs; n++){
+			if(refs.defs[n] >= FIRST_VIRTUAL){
+				low = std::min(low, refs.defs[n]);
+				high = std::max(high, refs.defs[n]);
+			}
+		}
+	}
+	base = low == INT_MAX ? FIRST_VIRTUAL : low;
+	slots = NREGS + high + 1 - base;
+}
+
+void LinearScan::liveness()
+{
+	const std::vector<Cfg::Block>& blocks = cfg.blocks();
+	size_t words = (slots + 63) / 64;
+	live.assign(blocks.size(), Liveness());
+	for(size_t b=0; b<blocks.size(); b++){
+		Liveness& l = live[b];
+		l.gen.assign(words, 0);
+		l.kill.assign(words, 0);
+		l.in.assign(words, 0);
+		l.out.assign(words, 0);
+		for(size_t k=blocks[b].first; k<=blocks[b].last; k++){
+			Refs refs(code[k]);
+			for(int n=0; n<refs.nUses; n++){
+				int s = slot(refs.uses[n]);
+				if(!testBit(l.kill, s)) setBit(l.gen, s);
+			}
+			for(int n=0; n<refs.nDefs; n++) setBit(l.kill, slot(refs.defs[n]));
+		}
+	}
+	setBit(live.back().out, 0);	//The return value
+
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(size_t b=blocks.size(); b-- > 0;){
+			Liveness& l = live[b];
+			const std::vector<int>& succ = blocks[b].succ;
+			for(size_t s=0; s<succ.size(); s++){
+				const RegSet& in = live[succ[s]].in;
+				for(size_t w=0; w<words; w++) l.out[w] |= in[w];
+			}
+			for(size_t w=0; w<words; w++){
+				uint64_t in = l.gen[w] | (l.out[w] & ~l.kill[w]);
+				if(in != l.in[w]){
+					l.in[w] = in;
+					changed = true;
+				}
+			}
+		}
+	}
+}
+
+/*
+Virtual registers get a single interval from their first to their last live
+position. Physical registers are only live for short stretches around calls,
+parameters and the return value, so they keep their exact ranges.
+*/
+void LinearScan::buildIntervals()
+{
+	intervals.assign(slots - NREGS, Interval());
+	for(int r=0; r<NREGS; r++) fixed[r].clear();
+
+	const std::vector<Cfg::Block>& blocks = cfg.blocks();
+	for(size_t b=0; b<blocks.size(); b++){
+		const Cfg::Block& block = blocks[b];
+		int start = pos(block.first);
+		int end = pos(block.last) + 1;
+
+		for(size_t s=NREGS; s<slots; s++){
+			Interval& i = intervals[s - NREGS];
+			if(testBit(live[b].in, s)) i.start = std::min(i.start, start);
+			if(testBit(live[b].out, s)) i.end = std::max(i.end, end);
+		}
+
+		int liveUntil[NREGS];
+		for(int r=0; r<NREGS; r++) liveUntil[r] = testBit(live[b].out, r) ? end : -1;
+
+		for(size_t k=block.last+1; k-- > block.first;){
+			const Instr& instr = code[k];
+			Refs refs(instr);
+			int use = pos(k), def = pos(k) + 1;
+
+			for(int n=0; n<refs.nDefs; n++){
+				int r = refs.defs[n];
+				if(r < NREGS){
+					fixed[r].push_back(std::make_pair(def, liveUntil[r] < 0 ? def : liveUntil[r]));
+					liveUntil[r] = -1;
+					continue;
+				}
+				Interval& i = intervals[r - base];
+				i.start = std::min(i.start, def);
+				i.end = std::max(i.end, def);
+				i.refs.push_back(def);
+			}
+			for(int n=0; n<refs.nUses; n++){
+				int r = refs.uses[n];
+				if(r < NREGS){
+					if(liveUntil[r] < 0) liveUntil[r] = use;
+					continue;
+				}
+				Interval& i = intervals[r - base];
+				i.start = std::min(i.start, use);
+				i.end = std::max(i.end, use);
+				i.refs.push_back(use);
+			}
+
+			//Copies to and from physical registers are free if both sides agree
+			if(instr.op == OP_MOV && instr.cond == NONE && !instr.immOperand() && instr.imm == 0){
+				if(instr.rd >= FIRST_VIRTUAL && instr.rm < NREGS) intervals[instr.rd - base].hint = instr.rm;
+				if(instr.rm >= FIRST_VIRTUAL && instr.rd < NREGS) intervals[instr.rm - base].hint = instr.rd;
+			}
+		}
+
+		for(int r=0; r<NREGS; r++){
+			if(liveUntil[r] >= 0) fixed[r].push_back(std::make_pair(start, liveUntil[r]));
+		}
+	}
+
+	for(size_t i=0; i<intervals.size(); i++){
+		std::sort(intervals[i].refs.begin(), intervals[i].refs.end());
+	}
+
+	//Sorted and merged, so a binary search finds any overlap
+	for(int r=0; r<NREGS; r++){
+		std::vector<std::pair<int, int> >& ranges = fixed[r];
+		std::sort(ranges.begin(), ranges.end());
+		size_t out = 0;
+		for(size_t n=0; n<ranges.size(); n++){
+			if(out > 0 && ranges[n].first <= ranges[out-1].second + 1){
+				ranges[out-1].second = std::max(ranges[out-1].second, ranges[n].second);
+			}
+			else ranges[out++] = ranges[n];
+		}
+		ranges.resize(out);
+	}
+}
+
+bool LinearScan::conflicts(int reg, const Interval& i)
+{
+	if(reg == SPARE) return false;	//Nothing uses r11 before it is given out
+	const std::vector<std::pair<int, int> >& ranges = fixed[reg];
+	auto it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(i.end, INT_MAX));
+	if(it == ranges.begin()) return false;
+	--it;
+	return it->second >= i.start;
+}
+
+static int nextRef(const std::vector<int>& refs, int pos)
+{
+	auto it = std::lower_bound(refs.begin(), refs.end(), pos);
+	return it == refs.end() ? INT_MAX : *it;
+}
+
+bool LinearScan::scan()
+{
+	std::vector<int> order;
+	for(size_t n=0; n<intervals.size(); n++){
+		if(intervals[n].end >= 0) order.push_back(n);
+	}
+	std::sort(order.begin(), order.end(), [this](int a, int b){
+		if(intervals[a].start != intervals[b].start) return intervals[a].start < intervals[b].start;
+		return a < b;
+	});
+
+	bool complete = true;
+	std::vector<int> active;
+	for(size_t o=0; o<order.size(); o++){
+		Interval& cur = intervals[order[o]];
+
+		size_t kept = 0;
+		for(size_t a=0; a<active.size(); a++){
+			if(intervals[active[a]].end >= cur.start) active[kept++] = active[a];
+		}
+		active.resize(kept);
+
+		bool busy[NREGS + 1] = {};
+		for(size_t a=0; a<active.size(); a++) busy[intervals[active[a]].reg] = true;
+
+		int reg = -1;
+		if(cur.hint >= 0 && !busy[cur.hint] && !conflicts(cur.hint, cur)) reg = cur.hint;
+		for(int r=0; r<registers && reg < 0; r++){
+			if(!busy[r] && !conflicts(r, cur)) reg = r;
+		}
+		if(reg >= 0){
+			cur.reg = reg;
+			active.push_back(order[o]);
+			continue;
+		}
+
+		//Spill whichever of the candidates is referenced again last
+		bool temp = base + order[o] >= spillTemps;
+		int victim = temp ? -1 : order[o];
+		int furthest = temp ? -1 : nextRef(cur.refs, cur.start + 1);
+		size_t victimSlot = 0;
+		for(size_t a=0; a<active.size(); a++){
+			Interval& i = intervals[active[a]];
+			if(base + active[a] >= spillTemps || conflicts(i.reg, cur)) continue;
+			int next = nextRef(i.refs, cur.start);
+			if(next > furthest){
+				furthest = next;
+				victim = active[a];
+				victimSlot = a;
+			}
+		}
+		if(victim < 0) throw CompilerError("no register left for spill code");
+
+		complete = false;
+		intervals[victim].spilled = true;
+		if(victim != order[o]){
+			cur.reg = intervals[victim].reg;
+			active[victimSlot] = order[o];
+		}
+	}
+	return complete;
+}
+
+/*
+Spilled registers live in a stack slot. Each instruction that reads one
+loads it into a fresh register first, each one that writes one stores it
+after, and those registers only live for the one instruction.
+*/
+void LinearScan::spill()
+{
+	std::vector<int> stackSlot(intervals.size());
+	for(size_t n=0; n<intervals.size(); n++){
+		if(intervals[n].spilled) stackSlot[n] = StackStore::allocate(4);
+	}
+
+	std::vector<Instr> body(code.begin() + from, code.end());
+	code.resize(from);
+	code.reserve(from + body.size());
+
+	for(size_t k=0; k<body.size(); k++){
+		Instr i = body[k];
+		Refs refs(i);
+
+		int spilled[4], temps[4];
+		int count = 0;
+		auto tempFor = [&](int r){
+			for(int n=0; n<count; n++) if(spilled[n] == r) return temps[n];
+			spilled[count] = r;
+			temps[count] = RegAlloc::newVirtual();
+			spillTemps = std::min(spillTemps, temps[count]);
+			return temps[count++];
+		};
+		auto isSpilled = [&](int r){
+			return r >= FIRST_VIRTUAL && intervals[r - base].spilled;
+		};
+
+		for(int n=0; n<refs.nUses; n++){
+			int r = refs.uses[n];
+			if(!isSpilled(r)) continue;
+			bool loaded = false;
+			for(int m=0; m<count; m++) loaded |= spilled[m] == r;
+			if(loaded) continue;
+			Stats::count(COUNT_RELOADS);
+			code.push_back(StackOp(false, tempFor(r), stackSlot[r - base]));
+		}
+		for(int n=0; n<refs.nDefs; n++){
+			if(isSpilled(refs.defs[n])) tempFor(refs.defs[n]);
+		}
+
+		for(int n=0; n<count; n++){
+			if(i.rd == spilled[n]) i.rd = temps[n];
+			if(i.rn == spilled[n]) i.rn = temps[n];
+			if(!i.immOperand() && i.rm == spilled[n]) i.rm = temps[n];
+			if(i.accumulates() && i.imm == spilled[n]) i.imm = temps[n];
+		}
+		code.push_back(i);
+
+		for(int n=0; n<refs.nDefs; n++){
+			int r = refs.defs[n];
+			if(!isSpilled(r)) continue;
+			Stats::count(COUNT_SPILLS);
+			code.push_back(StackOp(true, tempFor(r), stackSlot[r - base]));
+		}
+	}
+}
+
+/*
+Rewrites virtual registers to their physical ones. Copies whose two sides
+ended up in the same register are left for Peephole to drop.
+
+Before ARMv6 the result of MUL and MLA must not be in the register of their
+first operand. The operands are swapped where that leaves it in the second
+only, and x * x is read from a copy in the scratch register.
+*/
+void LinearScan::assign()
+{
+	for(size_t n=0; n<intervals.size(); n++){
+		if(intervals[n].reg == SPARE) intervals[n].reg = 11;
+	}
+	for(size_t k=from; k<code.size(); k++){
+		Instr& i = code[k];
+		if(i.rd >= FIRST_VIRTUAL) i.rd = intervals[i.rd - base].reg;
+		if(i.rn >= FIRST_VIRTUAL) i.rn = intervals[i.rn - base].reg;
+		if(i.rm >= FIRST_VIRTUAL) i.rm = intervals[i.rm - base].reg;
+		if(i.accumulates() && i.imm >= FIRST_VIRTUAL) i.imm = intervals[i.imm - base].reg;
+
+		if((i.op != OP_MUL && i.op != OP_MLA) || i.rd != i.rn) continue;
+		if(i.rm != i.rd){
+			std::swap(i.rn, i.rm);
+			continue;
+		}
+		i.rn = RegAlloc::getScratch();
+		code.insert(code.begin() + k, MoveBlock(i.rn, FlexSrc(i.rm), (Flag)i.cond));
+		k++;
+	}
+}
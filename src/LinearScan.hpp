@@ -0,0 +1,79 @@
+#ifndef LINEARSCAN_H
+#define LINEARSCAN_H
+
+#include <vector>
+#include <utility>
+#include <climits>
+#include <cstdint>
+#include "CodeGen.hpp"
+#include "Allocation.hpp"
+#include "Cfg.hpp"
+
+/*
+Register allocator for --regalloc=linear. Functions are generated with a
+virtual register for every value and allocated as a whole once the body is
+complete: liveness over the blocks of the function gives each virtual
+register one live interval, intervals are given physical registers in order
+of their start, and when none is free the value whose next reference is
+furthest away is spilled. Spilled values are rewritten to go through a
+stack slot around each reference and the function is allocated again.
+
+Calls only overwrite r0-r3, so values live across one are given r4 and up.
+Where the body doesn't move sp, Frame addresses the stack slots from sp
+and r11 is free as well.
+*/
+class LinearScan
+{
+public:
+	//Allocates the code from instruction index from to the end
+	static void allocate(size_t from);
+
+private:
+	typedef std::vector<uint64_t> RegSet;	//One bit per slot, see slot()
+
+	//Of each block of cfg
+	struct Liveness
+	{
+		RegSet gen, kill, in, out;
+	};
+
+	//Positions are 2k for the reads and 2k+1 for the writes of instruction k
+	struct Interval
+	{
+		int start = INT_MAX;
+		int end = -1;
+		std::vector<int> refs;	//Positions that read or write it
+		int hint = -1;		//Physical register it is copied from or to
+		int reg = -1;
+		bool spilled = false;
+	};
+
+	std::vector<Instr>& code;
+	size_t from;
+	int base;		//Lowest virtual register in the code
+	int spillTemps;		//First register made for spill code, which is never spilled itself
+	size_t slots;
+	int registers;		//Allocatable: r0 to r(NREGS-1), and NREGS standing for r11 if there is no frame pointer
+
+	Cfg cfg;
+	std::vector<Liveness> live;
+	std::vector<Interval> intervals;	//Of virtual register base + i
+	std::vector<std::pair<int, int> > fixed[NREGS];	//Ranges each physical register is live over
+
+	static const int SPARE = NREGS;
+
+	LinearScan(size_t from);
+
+	int slot(int r){return r < NREGS ? r : NREGS + r - base;}
+	int pos(size_t k){return 2 * (k - from);}
+	bool conflicts(int reg, const Interval& i);
+
+	void numberVirtuals();
+	void liveness();
+	void buildIntervals();
+	bool scan();	//False if anything was spilled
+	void spill();
+	void assign();
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "MappedFile.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile():
+	data(NULL), length(0), mapped(false)
+{}
+
+MappedFile::~MappedFile()
+{
+	if(length > 0) munmap(data, length);
+}
+
+bool MappedFile::open(const char* path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0) return false;
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+		close(fd);
+		return false;
+	}
+
+	//An empty file cannot be mapped, but it is still a valid (empty) source
+	if(st.st_size > 0){
+		void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED){
+			close(fd);
+			return false;
+		}
+		data = static_cast<char*>(p);
+		length = st.st_size;
+		madvise(data, length, MADV_SEQUENTIAL);
+	}
+
+	close(fd);
+	mapped = true;
+	return true;
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+/*
+Read-only memory mapping of a whole source file. Only regular files can be
+mapped; for anything else (pipes, terminals) open() fails and the caller
+falls back to reading the file as a stream.
+*/
+class MappedFile
+{
+	char* data;
+	size_t length;
+	bool mapped;
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+
+	bool isOpen() const
+	{
+		return mapped;
+	}
+
+	const char* begin() const
+	{
+		return data;
+	}
+
+	const char* end() const
+	{
+		return data + length;
+	}
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Multiply.hpp"
+
+/*
+With n in canonical signed digit form, each digit from the top down shifts
+what has been built so far and adds or subtracts rn: ADD rd, rn, rd, LSL #k
+or RSB rd, rn, rd, LSL #k. The zeros below the lowest digit are one more
+shift, and a negative constant is negated at the end.
+*/
+void Multiply::plan(int rd, int rn, int32_t c, std::vector<Instr>& out)
+{
+	if(c == 0){
+		out.push_back(MoveBlock(rd, Imm(0)));
+		return;
+	}
+	bool negative = c < 0;
+	uint64_t n = negative ? -(int64_t)c : c;
+
+	std::vector<std::pair<int, int> > digits;	//Position and sign, lowest first
+	for(int pos=0; n != 0; pos++, n >>= 1){
+		if(!(n & 1)) continue;
+		int sign = (n & 3) == 3 ? -1 : 1;
+		digits.push_back(std::make_pair(pos, sign));
+		n -= sign;
+	}
+
+	int acc = rn;
+	for(size_t d = digits.size() - 1; d-- > 0; ){
+		int shift = digits[d+1].first - digits[d].first;
+		out.push_back(ShiftedBlock(digits[d].second > 0 ? OP_ADD : OP_RSB, rd, rn, acc, shift));
+		acc = rd;
+	}
+	int low = digits[0].first;
+	if(low > 0 || (acc == rn && !negative)){
+		out.push_back(ShiftedBlock(OP_MOV, rd, -1, acc, low));
+		acc = rd;
+	}
+	if(negative) out.push_back(RSBBlock(rd, acc, Imm(0)));
+}
+
+bool Multiply::reducible(int32_t c)
+{
+	std::vector<Instr> out;
+	plan(0, 1, c, out);
+	return out.size() <= MUL_COST;
+}
+
+void Multiply::byConstant(int rd, int rn, int32_t c)
+{
+	std::vector<Instr> out;
+	plan(rd, rn, c, out);
+	for(const Instr& i: out) CodeGen::push(i);
+}
@@ -0,0 +1,29 @@
+#ifndef MULTIPLY_H
+#define MULTIPLY_H
+
+#include <cstdint>
+#include <vector>
+#include "CodeGen.hpp"
+
+/*
+Multiplication by a constant as adds and subtracts of shifted copies through
+the barrel shifter, one per non-zero digit of the constant in signed binary.
+MUL needs the constant in a register first and takes a few cycles longer
+than an ALU instruction, so the shifts are only used while they are no
+longer than MUL_COST instructions.
+*/
+class Multiply
+{
+public:
+	static const size_t MUL_COST = 3;
+
+	//Whether rd = rn * c is cheaper done by byConstant than by MUL
+	static bool reducible(int32_t c);
+	//rd = rn * c, where rd and rn must be different registers
+	static void byConstant(int rd, int rn, int32_t c);
+
+private:
+	static void plan(int rd, int rn, int32_t c, std::vector<Instr>& out);
+};
+
+#endif
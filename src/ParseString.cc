@@ -1,8 +1,82 @@
 #include "ParseString.hpp"
 
-int parseInt(std::string s)
+static int digitValue(char c)
 {
-	return std::stoi(s);
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return 16;
+}
+
+/*
+Value of a character constant such as 'a', '\n', '\x41' or L'b'. Constants
+with several characters are packed a byte at a time like gcc does.
+*/
+static unsigned parseChar(const char* p, const char* e)
+{
+	bool wide = *p != '\'';
+	while(*p != '\'') p++;	//Skip the u/U/L prefix
+	p++;
+	e--;	//Closing quote
+	
+	unsigned value = 0;
+	while(p < e){
+		unsigned c;
+		if(*p != '\\'){
+			c = (unsigned char)*p++;
+		}
+		else if(p[1] == 'x'){
+			p += 2;
+			for(c = 0; p < e && digitValue(*p) < 16; p++) c = c * 16 + digitValue(*p);
+		}
+		else if(p[1] >= '0' && p[1] <= '7'){
+			p++;
+			c = 0;
+			for(int n = 0; n < 3 && p < e && *p >= '0' && *p <= '7'; n++, p++) c = c * 8 + (*p - '0');
+		}
+		else{
+			switch(p[1]){
+				case 'a': c = '\a'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'n': c = '\n'; break;
+				case 'r': c = '\r'; break;
+				case 't': c = '\t'; break;
+				case 'v': c = '\v'; break;
+				default: c = (unsigned char)p[1]; break;	// \' \" \? \\ .
+			}
+			p += 2;
+		}
+		value = wide ? c : (value << 8) | (c & 0xff);
+	}
+	return value;
+}
+
+/*
+Value of an integer constant token: decimal, octal, hex (any integer suffix
+is ignored) or a character constant. Values wrap to 32 bits.
+*/
+int parseInt(TokenSpan t)
+{
+	const char* p = t.begin;
+	const char* e = t.begin + t.size;
+	
+	if(e[-1] == '\'') return parseChar(p, e);
+	
+	unsigned base = 10;
+	if(p[0] == '0' && t.size > 1 && (p[1] == 'x' || p[1] == 'X')){
+		base = 16;
+		p += 2;
+	}
+	else if(p[0] == '0') base = 8;
+	
+	unsigned value = 0;
+	for(; p < e; p++){
+		unsigned d = digitValue(*p);
+		if(d >= base) break;	//Suffix
+		value = value * base + d;
+	}
+	return (int)value;
 }
 
 
@@ -2,8 +2,9 @@
 #define PARSESTRING_H
 
 #include <string>
+#include "Symbol.h"
 
-int parseInt(std::string);
+int parseInt(TokenSpan);
 double parseFloat(std::string);
 
 #endif
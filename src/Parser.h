@@ -24,8 +24,13 @@ class Parser: public ParserBase
         
     public:
         Parser() = default;
+        explicit Parser(std::istream &in);
         int parse();
 
+        void setBuffer(char const *begin, char const *end);
+                                        // parse in-memory source instead
+                                        // of the scanner's input stream
+
     private:
         void error();                   // called on (syntax) errors
         int lex();                      // returns the next token from the
@@ -41,5 +46,15 @@ class Parser: public ParserBase
         void print__();
 };
 
+inline Parser::Parser(std::istream &in)
+:
+    d_scanner(in)
+{}
+
+inline void Parser::setBuffer(char const *begin, char const *end)
+{
+    d_scanner.setBuffer(begin, end);
+}
+
 
 #endif
@@ -110,7 +110,7 @@ class ParserBase
     };
 
 // $insert STYPE
-typedef Branch* STYPE__;
+typedef SemanticValue STYPE__;
 
 
     private:
@@ -0,0 +1,282 @@
+#include "Peephole.hpp"
+#include "Refs.hpp"
+#include <unordered_set>
+
+//Tried in order at every position
+const Peephole::Rule Peephole::rules[] = {
+	{&Peephole::noEffect, COUNT_PEEPHOLE_NO_EFFECT},
+	{&Peephole::storeLoad, COUNT_PEEPHOLE_STORE_LOAD},
+	{&Peephole::branchToNext, COUNT_PEEPHOLE_BRANCH_NEXT},
+	{&Peephole::boolCompare, COUNT_PEEPHOLE_BOOL_COMPARE},
+	{&Peephole::ifConvert, COUNT_PEEPHOLE_IF_CONVERT},
+};
+
+Peephole::Peephole(size_t f):
+	code(CodeGen::instructions()), from(f), removed(code.size() - f, false), dropped(0)
+{
+	for(size_t k=from; k<code.size(); k++){
+		if(code[k].op == OP_LABEL) labels[code[k].imm] = k;
+		if(code[k].op == OP_B) targets[code[k].imm]++;
+	}
+}
+
+void Peephole::run(size_t from)
+{
+	if(from >= CodeGen::size()) return;
+
+	Peephole pass(from);
+	std::vector<Instr>& code = pass.code;
+	bool changed = true;
+	while(changed){
+		changed = false;
+		for(size_t k=from; k<code.size(); k++){
+			for(const Rule& rule: rules){
+				if(pass.removed[k - from]) break;
+				if((pass.*rule.apply)(k)){
+					Stats::count(rule.hits);
+					changed = true;
+				}
+			}
+		}
+	}
+
+	size_t out = from;
+	for(size_t k=from; k<code.size(); k++){
+		if(!pass.removed[k - from]) code[out++] = code[k];
+	}
+	code.resize(out);
+	Stats::count(COUNT_PEEPHOLE_REMOVED, pass.dropped);
+}
+
+size_t Peephole::next(size_t k)
+{
+	for(k++; k<code.size() && removed[k - from]; k++)
+		;
+	return k;
+}
+
+void Peephole::remove(size_t k)
+{
+	removed[k - from] = true;
+	dropped++;
+	if(code[k].op == OP_B) targets[code[k].imm]--;
+}
+
+/*
+Follows every path from instruction k until reg is written or read. Gives up
+and says it is live on paths that leave the code or go on for too long.
+*/
+bool Peephole::dead(size_t k, int reg)
+{
+	if(reg >= 0 && !tracked(reg)) return false;
+
+	std::vector<size_t> work;
+	std::unordered_set<size_t> seen;
+	const Instr& branch = code[k];
+	if(branch.op == OP_B){
+		auto it = labels.find(branch.imm);
+		if(it == labels.end()) return false;
+		work.push_back(it->second);
+	}
+	if(branch.op != OP_B || branch.cond != NONE) work.push_back(next(k));
+
+	int budget = 256;
+	while(!work.empty()){
+		size_t p = work.back();
+		work.pop_back();
+		for(;; p = next(p)){
+			if(p >= code.size() || --budget < 0) return false;
+			const Instr& i = code[p];
+			if(i.op == OP_LABEL && !seen.insert(p).second) break;
+			if(i.cond == NEVER) continue;
+
+			if(reg < 0){
+				if(i.cond != NONE) return false;
+				if(i.op == OP_CMP || i.op == OP_BL) break;
+			}
+			else{
+				Refs refs(i);
+				for(int n=0; n<refs.nUses; n++) if(refs.uses[n] == reg) return false;
+				bool written = false;
+				for(int n=0; n<refs.nDefs; n++) written |= refs.defs[n] == reg;
+				if(written && i.cond == NONE) break;
+			}
+
+			if(i.returns()) break;
+			if(i.op == OP_B){
+				auto it = labels.find(i.imm);
+				if(it == labels.end()) return false;
+				work.push_back(it->second);
+				if(i.cond == NONE) break;
+			}
+		}
+	}
+	return true;
+}
+
+//Instructions that can't change anything: never executed, adding zero to
+//a register in place, copying a register to itself unshifted, or pushing nothing
+bool Peephole::noEffect(size_t k)
+{
+	const Instr& i = code[k];
+	bool none = i.cond == NEVER;
+	switch(i.op){
+		case OP_ADD:
+		case OP_SUB:
+		case OP_ORR:
+			none |= i.immOperand() && i.imm == 0 && i.rd == i.rn;
+			break;
+		case OP_MOV:
+			none |= !i.immOperand() && i.imm == 0 && i.rd == i.rm;
+			break;
+		case OP_PUSH:
+		case OP_POP:
+			none |= i.regList == 0;
+			break;
+	}
+	if(!none) return false;
+	remove(k);
+	return true;
+}
+
+//STR rX, [fp, #n] then LDR rY, [fp, #n]: the value is still in rX
+bool Peephole::storeLoad(size_t k)
+{
+	const Instr& store = code[k];
+	if(store.op != OP_STR || store.cond != NONE) return false;
+	size_t l = next(k);
+	if(l >= code.size()) return false;
+	Instr& load = code[l];
+	if(load.op != OP_LDR || load.cond != NONE || load.rn != store.rn || load.imm != store.imm) return false;
+
+	if(load.rd == store.rd) remove(l);
+	else load = MoveBlock(load.rd, store.rd);
+	return true;
+}
+
+//A branch to a label that follows it with nothing but labels in between
+bool Peephole::branchToNext(size_t k)
+{
+	const Instr& branch = code[k];
+	if(branch.op != OP_B || branch.cond == NEVER) return false;
+	for(size_t l = next(k); l < code.size() && code[l].op == OP_LABEL; l = next(l)){
+		if(code[l].imm == branch.imm){
+			remove(k);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+MOV r, #0; MOVcc r, #1; CMP r, #0; BEQ/BNE l turns a comparison into a
+boolean only to test it again. If nothing reads r or the flags afterwards,
+branching on the first comparison's flags does the same.
+*/
+bool Peephole::boolCompare(size_t k)
+{
+	const Instr& zero = code[k];
+	if(zero.op != OP_MOV || zero.cond != NONE || !zero.immOperand() || zero.imm != 0) return false;
+	size_t k1 = next(k);
+	size_t k2 = k1 < code.size() ? next(k1) : k1;
+	size_t k3 = k2 < code.size() ? next(k2) : k2;
+	if(k3 >= code.size()) return false;
+
+	const Instr& one = code[k1];
+	const Instr& cmp = code[k2];
+	Instr& branch = code[k3];
+	if(one.op != OP_MOV || one.cond == NONE || one.cond == NEVER || !one.immOperand() || one.imm != 1 || one.rd != zero.rd) return false;
+	if(cmp.op != OP_CMP || cmp.rn != zero.rd || !cmp.immOperand() || cmp.imm != 0) return false;
+	if(branch.op != OP_B || (branch.cond != EQ && branch.cond != NE)) return false;
+	if(!dead(k3, zero.rd) || !dead(k3, -1)) return false;
+
+	Flag f = (Flag)one.cond;
+	branch.cond = branch.cond == EQ ? flagInvert(f) : f;
+	remove(k);
+	remove(k1);
+	remove(k2);
+	return true;
+}
+
+//Longest arm ifConvert puts under a condition, in instructions
+static const size_t MAX_ARM = 4;
+
+//Can be made conditional without setting the flags or going anywhere
+static bool predicable(const Instr& i)
+{
+	if(i.cond != NONE) return false;
+	switch(i.op){
+		case OP_MOV:
+		case OP_MVN:
+		case OP_ADD:
+		case OP_SUB:
+		case OP_RSB:
+		case OP_AND:
+		case OP_ORR:
+		case OP_STR:
+		case OP_LDR:
+		case OP_LDRLIT:
+		case OP_LDRCONST:
+			return i.rd < 13;
+	}
+	return false;
+}
+
+size_t Peephole::arm(size_t k, std::vector<size_t>& out)
+{
+	for(; k < code.size() && predicable(code[k]); k = next(k)){
+		if(out.size() == MAX_ARM) return code.size();
+		out.push_back(k);
+	}
+	return k;
+}
+
+size_t Peephole::labelRun(size_t k, Label l)
+{
+	for(; k < code.size() && code[k].op == OP_LABEL; k = next(k)){
+		if(code[k].imm == l) return k;
+	}
+	return code.size();
+}
+
+/*
+Bcc l1; a; B l2; l1: b; l2: branches round one of two short arms, and
+Bcc l1; a; l1: round a single one. Running a under the opposite condition
+and b under cc does the same without a branch to mispredict; nothing in the
+arms sets the flags, so they still hold for b once a is done.
+*/
+bool Peephole::ifConvert(size_t k)
+{
+	const Instr& branch = code[k];
+	if(branch.op != OP_B || branch.cond == NONE || branch.cond == NEVER) return false;
+	Flag cc = (Flag)branch.cond;
+	Label skip = branch.imm;
+
+	std::vector<size_t> first, second;
+	size_t p = arm(next(k), first);
+	if(p >= code.size()) return false;
+
+	size_t end, middle = code.size(), jump = code.size();
+	if(code[p].op == OP_LABEL) end = labelRun(p, skip);
+	else{
+		//The label between the arms may only be reached from branch
+		jump = p;
+		middle = next(p);
+		const Instr& over = code[jump];
+		if(over.op != OP_B || over.cond != NONE || over.imm == skip || middle >= code.size()) return false;
+		if(code[middle].op != OP_LABEL || code[middle].imm != skip || targets[skip] != 1) return false;
+		size_t q = arm(next(middle), second);
+		end = q < code.size() ? labelRun(q, over.imm) : q;
+	}
+	if(end >= code.size()) return false;
+
+	for(size_t n: first) code[n].cond = flagInvert(cc);
+	for(size_t n: second) code[n].cond = cc;
+	remove(k);
+	if(jump < code.size()){
+		remove(jump);
+		remove(middle);
+	}
+	if(targets[code[end].imm] == 0) remove(end);
+	return true;
+}
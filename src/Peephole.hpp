@@ -0,0 +1,51 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <vector>
+#include <unordered_map>
+#include "CodeGen.hpp"
+#include "Stats.hpp"
+
+/*
+Pattern driven clean up of a function's finished code. Each rule in the
+table looks at the instructions from one position on and rewrites or removes
+the ones it matches; the rules are tried everywhere until none applies, and
+each rule counts its hits and the instructions it removed for --stats.
+*/
+class Peephole
+{
+public:
+	//Runs over the code from instruction index from to the end
+	static void run(size_t from);
+
+private:
+	struct Rule
+	{
+		bool (Peephole::*apply)(size_t k);
+		Counter hits;
+	};
+	static const Rule rules[];
+
+	std::vector<Instr>& code;
+	size_t from;
+	std::vector<bool> removed;
+	std::unordered_map<int32_t, size_t> labels;	//Index of each label in the code
+	std::unordered_map<int32_t, int> targets;	//Branches to each label still in the code
+	size_t dropped;
+
+	Peephole(size_t from);
+
+	size_t next(size_t k);	//First instruction after k that is still there
+	void remove(size_t k);
+	bool dead(size_t k, int reg);	//Whether nothing after k reads reg, or the flags if reg is -1
+	size_t arm(size_t k, std::vector<size_t>& out);	//Short run of predicable instructions from k, returning where it stops
+	size_t labelRun(size_t k, Label l);	//Where l is in the labels from k on, or code.size()
+
+	bool noEffect(size_t k);
+	bool storeLoad(size_t k);
+	bool branchToNext(size_t k);
+	bool boolCompare(size_t k);
+	bool ifConvert(size_t k);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef REFS_H
+#define REFS_H
+
+#include "CodeGen.hpp"
+#include "Allocation.hpp"
+
+inline bool tracked(int r)
+{
+	return r >= 0 && (r < NREGS || r >= FIRST_VIRTUAL);
+}
+
+/*
+Registers one instruction reads and writes, for the passes over the
+instruction stream. Only allocatable and virtual registers are listed, fp
+and the other fixed registers are never allocated. r11 is left out even
+where LinearScan gives it out, which it does last, so to the passes after
+it r11 is simply never known to be dead.
+*/
+struct Refs
+{
+	int uses[NREGS + 2];
+	int nUses = 0;
+	int defs[NREGS + 1];
+	int nDefs = 0;
+
+	void use(int r){if(tracked(r)) uses[nUses++] = r;}
+	void def(int r){if(tracked(r)) defs[nDefs++] = r;}
+
+	void useList(uint16_t list)
+	{
+		for(int r=0; r<NREGS; r++) if(list & (1 << r)) use(r);
+	}
+
+	Refs(const Instr& i)
+	{
+		if(i.cond == NEVER) return;
+
+		switch(i.op){
+			case OP_ADD:
+			case OP_SUB:
+			case OP_RSB:
+			case OP_AND:
+			case OP_ORR:
+				use(i.rn);
+				//fallthrough
+			case OP_MOV:
+			case OP_MVN:
+				if(!i.immOperand()) use(i.rm);
+				if(i.cond != NONE) use(i.rd);	//Keeps its old value if the condition fails
+				def(i.rd);
+				break;
+			case OP_MUL:
+			case OP_MLA:
+				use(i.rn);
+				use(i.rm);
+				if(i.accumulates()) use(i.imm);
+				if(i.cond != NONE) use(i.rd);
+				def(i.rd);
+				break;
+			case OP_CMP:
+				use(i.rn);
+				if(!i.immOperand()) use(i.rm);
+				break;
+			case OP_STR:
+				use(i.rd);
+				break;
+			case OP_LDR:
+			case OP_LDRLIT:
+			case OP_LDRCONST:
+				def(i.rd);
+				break;
+			case OP_PUSH:
+				useList(i.regList);
+				break;
+			case OP_POP:
+				for(int r=0; r<NREGS; r++) if(i.regList & (1 << r)) def(r);
+				break;
+			case OP_B:
+				useList(i.regList);	//Arguments of a tail call
+				break;
+			case OP_BL:
+				//Only r0-r3 are left to the callee, see Frame
+				useList(i.regList);
+				for(int r=0; r<CALLER_SAVED; r++) def(r);
+				break;
+		}
+		if(i.returns()) use(0);	//The result
+	}
+};
+
+#endif
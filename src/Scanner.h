@@ -5,6 +5,7 @@
 
 // $insert baseclass_h
 #include "Scannerbase.h"
+#include "Symbol.h"
 
 
 // $insert classHead
@@ -19,8 +20,26 @@ class Scanner: public ScannerBase
         // $insert lexFunctionDecl
         int lex();
 
+        void setBuffer(char const *begin, char const *end);
+                            // scan the given bytes (e.g. a mapped file)
+                            // instead of the input stream
+
+        std::string matched() const;    // text of the last token
+        TokenSpan span() const;         // same, as a view that is valid
+                                        // until the next token
+        int value() const;              // SymbolId of an IDENTIFIER, value
+                                        // of an I_CONSTANT
+
     private:
+        char const *d_pos = 0;          // buffer mode: next unscanned byte
+        char const *d_end = 0;
+        TokenSpan d_span = {0, 0};
+        bool d_buffered = false;
+        int d_value = 0;
+
         int lex__();
+        int lexBuffer();
+        int bufferToken(char const *end, int token);
         int executeAction__(size_t ruleNr);
 
         void print();
@@ -46,7 +65,41 @@ inline Scanner::Scanner(std::string const &infile, std::string const &outfile)
 // $insert inlineLexFunction
 inline int Scanner::lex()
 {
-    return lex__();
+    return d_buffered ? lexBuffer() : lex__();
+}
+
+inline void Scanner::setBuffer(char const *begin, char const *end)
+{
+    d_pos = begin;
+    d_end = end;
+    d_buffered = true;
+}
+
+inline std::string Scanner::matched() const
+{
+    return d_buffered ? std::string(d_span.begin, d_span.size)
+                      : ScannerBase::matched();
+}
+
+inline TokenSpan Scanner::span() const
+{
+    if (d_buffered)
+        return d_span;
+    std::string const &text = ScannerBase::matched();
+    return TokenSpan{text.data(), text.size()};
+}
+
+inline int Scanner::value() const
+{
+    return d_value;
+}
+
+inline int Scanner::bufferToken(char const *end, int token)
+{
+    d_span.begin = d_pos;
+    d_span.size = end - d_pos;
+    d_pos = end;
+    return token;
 }
 
 inline void Scanner::preCode() 
@@ -1,8 +1,16 @@
-#include "CodeGen.hpp"
-#include "Allocation.hpp"
+#include "Compilation.hpp"
+#include "Branches.h"
 
-std::vector<CodeBlock*> CodeGen::blocks;
-
-std::vector<StackScope*> StackStore::scopes;
+//Per file state of the static facades, see Compilation.hpp
 
+SymbolTable::State& SymbolTable::state(){return Compilation::current().symbols;}
+ScopeTable::State& ScopeTable::state(){return Compilation::current().scopes;}
+TranslationUnit*& TopBranch::tu(){return Compilation::current().tu;}
 
+CodeGen::State& CodeGen::state(){return CodeBuffer::current().code;}
+LabelAlloc::State& LabelAlloc::state(){return CodeBuffer::current().labels;}
+LoopLabelJump::State& LoopLabelJump::state(){return CodeBuffer::current().loops;}
+RegAlloc::State& RegAlloc::state(){return CodeBuffer::current().regs;}
+StackStore::State& StackStore::state(){return CodeBuffer::current().stack;}
+StringBin::State& StringBin::state(){return CodeBuffer::current().strings;}
+KnownValues::State& KnownValues::state(){return CodeBuffer::current().known;}
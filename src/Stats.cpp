@@ -0,0 +1,140 @@
+#include "Stats.hpp"
+#include "Compilation.hpp"
+#include <cxxabi.h>
+#include <time.h>
+#include <cstdlib>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <typeinfo>
+
+bool Stats::timing = false;
+bool Stats::counting = false;
+
+static std::mutex totalsLock;
+static int64_t totalWall[PHASE_COUNT];
+static int64_t totalCpu[PHASE_COUNT];
+static uint64_t totalCounts[COUNT_COUNT];
+static std::map<std::string, uint64_t> nodeCounts;
+static int files;
+
+static const char* const phaseNames[] = {"scan", "parse", "resolve", "codegen", "directives", "emit"};
+static const char* const counterNames[] = {"tokens", "scope lookups", "dynamic_assign casts", "spills", "reloads",
+	"peephole no effect", "peephole store/load", "peephole branch next", "peephole bool compare", "peephole if convert", "peephole removed",
+	"ir fallbacks", "sccp constants", "sccp branches", "dce removed", "licm hoisted", "calls inlined",
+	"tail calls", "tail recursions looped", "frames omitted", "frame pointers omitted",
+	"known variable reads", "ifs folded"};
+
+static_assert(sizeof(phaseNames) / sizeof(*phaseNames) == PHASE_COUNT, "a Phase without a name");
+static_assert(sizeof(counterNames) / sizeof(*counterNames) == COUNT_COUNT, "a Counter without a name");
+
+uint64_t* Stats::counters()
+{
+	return CodeBuffer::current().counts;
+}
+
+static int64_t nanoseconds(clockid_t clock)
+{
+	timespec t;
+	clock_gettime(clock, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+int64_t Stats::wallNow()
+{
+	return nanoseconds(CLOCK_MONOTONIC);
+}
+
+int64_t Stats::cpuNow()
+{
+	return nanoseconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+Stats::Timer::Timer(Phase p, bool c):
+	phase(p), cpuOnly(c), wall(0), cpu(0)
+{
+	if(!timing) return;
+	wall = wallNow();
+	cpu = cpuNow();
+}
+
+Stats::Timer::~Timer()
+{
+	if(!timing) return;
+	PhaseTime& t = Compilation::current().times[phase];
+	t.cpu += cpuNow() - cpu;
+	if(!cpuOnly) t.wall += wallNow() - wall;
+}
+
+static std::string className(const std::type_info& t)
+{
+	int status;
+	char* name = abi::__cxa_demangle(t.name(), NULL, NULL, &status);
+	if(status != 0) return t.name();
+	std::string s(name);
+	free(name);
+	return s;
+}
+
+void Stats::addFile(Compilation& unit)
+{
+	//Everything the tree is made of is still in the arena
+	std::map<std::string, uint64_t> nodes;
+	if(counting){
+		const std::vector<ArenaObject*>& live = unit.arena.liveObjects();
+		for(size_t i=0; i<live.size(); i++){
+			if(live[i] != NULL && dynamic_cast<Branch*>(live[i])) nodes[className(typeid(*live[i]))]++;
+		}
+	}
+
+	std::lock_guard<std::mutex> l(totalsLock);
+	files++;
+	for(int p=0; p<PHASE_COUNT; p++){
+		totalWall[p] += unit.times[p].wall;
+		totalCpu[p] += unit.times[p].cpu;
+	}
+	for(int c=0; c<COUNT_COUNT; c++){
+		totalCounts[c] += unit.code.counts[c];
+	}
+	for(auto it = nodes.begin(); it != nodes.end(); it++){
+		nodeCounts[it->first] += it->second;
+	}
+}
+
+void Stats::report(std::ostream& out)
+{
+	std::lock_guard<std::mutex> l(totalsLock);
+	char line[128];
+
+	if(timing){
+		out << "Time report, " << files << " file(s):\n";
+		snprintf(line, sizeof(line), "  %-12s %12s %12s\n", "phase", "wall ms", "cpu ms");
+		out << line;
+		int64_t wall = 0, cpu = 0;
+		for(int p=0; p<PHASE_COUNT; p++){
+			snprintf(line, sizeof(line), "  %-12s %12.3f %12.3f\n", phaseNames[p], totalWall[p] / 1e6, totalCpu[p] / 1e6);
+			out << line;
+			wall += totalWall[p];
+			cpu += totalCpu[p];
+		}
+		snprintf(line, sizeof(line), "  %-12s %12.3f %12.3f\n", "total", wall / 1e6, cpu / 1e6);
+		out << line;
+	}
+
+	if(counting){
+		out << "Stats:\n";
+		for(int c=0; c<COUNT_COUNT; c++){
+			snprintf(line, sizeof(line), "  %-24s %12llu\n", counterNames[c], (unsigned long long)totalCounts[c]);
+			out << line;
+		}
+		out << "  AST nodes:\n";
+		uint64_t total = 0;
+		for(auto it = nodeCounts.begin(); it != nodeCounts.end(); it++){
+			snprintf(line, sizeof(line), "    %-22s %12llu\n", it->first.c_str(), (unsigned long long)it->second);
+			out << line;
+			total += it->second;
+		}
+		snprintf(line, sizeof(line), "    %-22s %12llu\n", "total", (unsigned long long)total);
+		out << line;
+	}
+}
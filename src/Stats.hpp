@@ -0,0 +1,93 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+
+class Compilation;
+
+enum Phase
+{
+	PHASE_SCAN, PHASE_PARSE, PHASE_RESOLVE, PHASE_CODEGEN, PHASE_DIRECTIVES, PHASE_EMIT,
+	PHASE_COUNT
+};
+
+enum Counter
+{
+	COUNT_TOKENS,
+	COUNT_SCOPE_LOOKUPS,
+	COUNT_DYNAMIC_ASSIGN,	//dynamic_casts done by Branch::dynamic_assign
+	COUNT_SPILLS,		//Registers stored to the stack
+	COUNT_RELOADS,		//Variables loaded back from the stack
+	COUNT_PEEPHOLE_NO_EFFECT,	//Hits of each Peephole rule
+	COUNT_PEEPHOLE_STORE_LOAD,
+	COUNT_PEEPHOLE_BRANCH_NEXT,
+	COUNT_PEEPHOLE_BOOL_COMPARE,
+	COUNT_PEEPHOLE_IF_CONVERT,
+	COUNT_PEEPHOLE_REMOVED,		//Instructions the rules removed
+	COUNT_IR_FALLBACKS,	//Functions -O couldn't put through the IR
+	COUNT_SCCP_CONSTANTS,	//Values found to be constant
+	COUNT_SCCP_BRANCHES,	//Branches found to always go one way
+	COUNT_DCE_REMOVED,
+	COUNT_LICM_HOISTED,	//Values moved out of loops
+	COUNT_INLINED,		//Calls replaced by the callee's body
+	COUNT_TAIL_CALLS,	//Calls the callee returns from straight to the caller
+	COUNT_TAIL_RECURSION,	//Calls of a function to itself turned into loops
+	COUNT_FRAMES_OMITTED,	//Functions without any frame
+	COUNT_FP_OMITTED,	//Frames addressed from sp
+	COUNT_KNOWN_READS,	//Reads of variables known to be constant, folded
+	COUNT_KNOWN_IFS,	//Ifs whose condition folded, generating one arm
+	COUNT_COUNT
+};
+
+//Nanoseconds spent in one phase
+struct PhaseTime
+{
+	std::atomic<int64_t> wall{0};
+	std::atomic<int64_t> cpu{0};
+};
+
+/*
+Phase timers and hot path counters for --time-report and --stats.
+Both are off unless enabled before compiling starts; counters are kept per
+code buffer and timers per file, and each file is added to the totals once
+it is finished.
+*/
+class Stats
+{
+	static uint64_t* counters();	//Of the code buffer active on this thread
+
+public:
+	static bool timing;
+	static bool counting;
+
+	static void count(Counter c, uint64_t n = 1)
+	{
+		if(counting) counters()[c] += n;
+	}
+
+	static int64_t wallNow();
+	static int64_t cpuNow();	//CPU time of the calling thread
+
+	static void addFile(Compilation& unit);
+	static void report(std::ostream& out);
+
+	/*
+	Adds the time from construction to destruction to a phase of the active
+	compilation. cpuOnly is for work done on behalf of a phase on another
+	thread, whose wall time the phase already covers.
+	*/
+	class Timer
+	{
+		Phase phase;
+		bool cpuOnly;
+		int64_t wall;
+		int64_t cpu;
+	public:
+		Timer(Phase p, bool cpuOnly = false);
+		~Timer();
+	};
+};
+
+#endif
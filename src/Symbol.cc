@@ -1,21 +1,48 @@
 #include "Symbol.h"
+#include <cstring>
 
-void SymbolStore::push(std::string s)
+//FNV-1a
+size_t SymbolTable::hash(const char* s, size_t n)
 {
-	store.push_back(s);
+	uint32_t h = 2166136261u;
+	for(size_t i=0; i<n; i++){
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
 }
 
-std::string SymbolStore::pop()
+void SymbolTable::grow()
 {
-	auto s = store.back();
-	store.pop_back();
-	return s;
+	std::deque<std::string>& names = state().names;
+	std::vector<SymbolId>& slots = state().slots;
+	size_t size = slots.empty() ? 1024 : slots.size() * 2;
+	slots.assign(size, -1);
+	for(size_t id=0; id<names.size(); id++){
+		size_t i = hash(names[id].data(), names[id].size()) & (size - 1);
+		while(slots[i] != -1) i = (i + 1) & (size - 1);
+		slots[i] = id;
+	}
 }
 
-
-void SymbolStore::printTop()
+SymbolId SymbolTable::intern(const char* s, size_t n)
 {
-	std::cout << store.back() << std::endl;
+	std::deque<std::string>& names = state().names;
+	std::vector<SymbolId>& slots = state().slots;
+	
+	//Keep the table at most half full
+	if(names.size() * 2 >= slots.size()) grow();
+	
+	size_t mask = slots.size() - 1;
+	size_t i = hash(s, n) & mask;
+	while(slots[i] != -1){
+		const std::string& name = names[slots[i]];
+		if(name.size() == n && memcmp(name.data(), s, n) == 0) return slots[i];
+		i = (i + 1) & mask;
+	}
+	
+	SymbolId id = names.size();
+	names.emplace_back(s, n);
+	slots[i] = id;
+	return id;
 }
-
-std::vector<std::string> SymbolStore::store;
@@ -4,24 +4,57 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
+//Index of an interned identifier name
+typedef int32_t SymbolId;
 
+// Text of a token, as a view into the source
+struct TokenSpan
+{
+	const char* begin;
+	size_t size;
+};
 
-class SymbolStore
-//FIFO store for symbols
+class SymbolTable
+//Intern table for identifiers, every distinct name gets one SymbolId
 {
-	static std::vector<std::string> store;
+	public:
+	struct State
+	{
+		std::deque<std::string> names;	//Stable storage, indexed by id
+		std::vector<SymbolId> slots;	//Open addressed hash of ids, -1 is empty
+	};
+	
+	private:
+	static State& state();
+	static size_t hash(const char* s, size_t n);
+	static void grow();
 	
 	public:
-	static void push(std::string);
-	static std::string pop();
-	static void printTop();
+	static SymbolId intern(const char* s, size_t n);
+	
+	static SymbolId intern(TokenSpan t)
+	{
+		return intern(t.begin, t.size);
+	}
+	
+	static SymbolId intern(const std::string& s)
+	{
+		return intern(s.data(), s.size());
+	}
+	
+	static const std::string& name(SymbolId id)
+	{
+		return state().names[id];
+	}
 	
-	static void pop_into(std::string& t)
+	static size_t size()
 	{
-		t = store.back();
-		store.pop_back();
+		return state().names.size();
 	}
 };
 
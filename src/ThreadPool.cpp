@@ -0,0 +1,145 @@
+#include "ThreadPool.hpp"
+
+thread_local int ThreadPool::self = -1;
+
+ThreadPool::ThreadPool(unsigned n):
+	queued(0), nextWorker(0), stopping(false)
+{
+	if(n == 0) n = 1;
+	for(unsigned i=0; i<n; i++){
+		workers.emplace_back(new Worker());
+	}
+	self = 0;
+	for(unsigned i=1; i<n; i++){
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> l(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(size_t i=0; i<threads.size(); i++){
+		threads[i].join();
+	}
+	self = -1;
+}
+
+void ThreadPool::push(Task t)
+{
+	//Work created by a worker goes on its own deque, so related tasks stay
+	//together and the others only take it when they run out
+	unsigned target = self >= 0 ? self : nextWorker++ % workers.size();
+	{
+		std::lock_guard<std::mutex> l(workers[target]->lock);
+		workers[target]->tasks.push_back(std::move(t));
+	}
+	{
+		std::lock_guard<std::mutex> l(sleepLock);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+bool ThreadPool::runOne(unsigned index)
+{
+	Task t;
+	bool found = false;
+	{
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> l(own.lock);
+		if(!own.tasks.empty()){
+			t = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			found = true;
+		}
+	}
+	for(size_t i=1; i<workers.size() && !found; i++){
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> l(victim.lock);
+		if(!victim.tasks.empty()){
+			t = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			found = true;
+		}
+	}
+	if(!found) return false;
+
+	queued--;
+	std::exception_ptr e;
+	try{
+		t.run();
+	}
+	catch(...){
+		e = std::current_exception();
+	}
+	t.group->finished(e);
+	return true;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+	self = index;
+	while(true){
+		if(runOne(index)) continue;
+
+		std::unique_lock<std::mutex> l(sleepLock);
+		wake.wait(l, [this]{return stopping || queued > 0;});
+		if(stopping && queued == 0) return;
+	}
+}
+
+void TaskGroup::run(std::function<void()> f)
+{
+	pending++;
+	//Nothing to share the work with, keep it in order on the caller
+	if(pool.size() == 1){
+		std::exception_ptr e;
+		try{
+			f();
+		}
+		catch(...){
+			e = std::current_exception();
+		}
+		finished(e);
+		return;
+	}
+	ThreadPool::Task t = {std::move(f), this};
+	pool.push(std::move(t));
+}
+
+void TaskGroup::finished(std::exception_ptr e)
+{
+	if(e){
+		std::lock_guard<std::mutex> l(errorLock);
+		if(!error) error = e;
+	}
+	pending--;
+}
+
+void TaskGroup::help()
+{
+	unsigned index = ThreadPool::self >= 0 ? ThreadPool::self : 0;
+	while(pending > 0){
+		if(!pool.runOne(index)) std::this_thread::yield();
+	}
+}
+
+void TaskGroup::wait()
+{
+	help();
+	if(error){
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+TaskGroup::~TaskGroup()
+{
+	//Tasks refer to the group, it can't go away before they have run
+	help();
+}
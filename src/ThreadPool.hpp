@@ -0,0 +1,98 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+/*
+Work stealing thread pool. Every worker owns a deque of tasks: it takes new
+work from the back of its own deque and, when that runs dry, steals from the
+front of the others'. The thread that creates the pool counts as worker 0 and
+runs tasks while it waits on a TaskGroup, so a pool of one worker starts no
+threads and runs every task in submission order on the caller.
+*/
+class ThreadPool
+{
+	struct Task
+	{
+		std::function<void()> run;
+		TaskGroup* group;
+	};
+
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Worker> > workers;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<size_t> queued;
+	std::atomic<size_t> nextWorker;	//Round robin target for work from outside the pool
+	bool stopping;
+
+	static thread_local int self;	//Index of the worker running on this thread, -1 if none
+
+	void workerLoop(unsigned index);
+	bool runOne(unsigned index);
+	void push(Task t);
+
+	friend class TaskGroup;
+
+public:
+	ThreadPool(unsigned workers);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned size() const
+	{
+		return workers.size();
+	}
+};
+
+/*
+A set of tasks that can be waited on together. The first exception thrown by
+any of them is rethrown from wait().
+*/
+class TaskGroup
+{
+	ThreadPool& pool;
+	std::atomic<size_t> pending;
+	std::mutex errorLock;
+	std::exception_ptr error;
+
+	friend class ThreadPool;
+	void finished(std::exception_ptr e);
+	void help();
+
+public:
+	TaskGroup(ThreadPool& p):
+		pool(p), pending(0)
+	{}
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	~TaskGroup();
+
+	void run(std::function<void()> f);
+
+	//Helps with queued work until every task of the group has finished
+	void wait();
+};
+
+#endif
@@ -11,7 +11,7 @@ ScopedVariable::ScopedVariable(Declarator* d, TypeSpec* t)
 	auto ddb = dynamic_cast<DirectDeclaratorBase*>(std::get<1>(ptr_dd));
 	assert(ddb != NULL);
 	
-	identifier = ddb->format();
+	identifier = ddb->getSymbol();
 }
 
 ScopedVariable::ScopedVariable(Declarator* d, TypeSpec* t, int i):
@@ -24,7 +24,81 @@ ScopedVariable::ScopedVariable(Declarator* d, TypeSpec* t, int i):
 	auto ddb = dynamic_cast<DirectDeclaratorBase*>(std::get<1>(ptr_dd));
 	assert(ddb != NULL);
 	
-	identifier = ddb->format();
+	identifier = ddb->getSymbol();
+}
+
+void ScopeTable::begin()
+{
+	State& st = state();
+	st.marks.push_back(st.undo.size());
+}
+
+void ScopeTable::end()
+{
+	State& st = state();
+	std::vector<Binding>& current = st.current;
+	std::vector<std::pair<SymbolId, Binding> >& undo = st.undo;
+	std::vector<size_t>& marks = st.marks;
+	size_t mark = marks.back();
+	marks.pop_back();
+	while(undo.size() > mark){
+		current[undo.back().first] = undo.back().second;
+		undo.pop_back();
+	}
+}
+
+void ScopeTable::declare(Scoped* s)
+{
+	State& st = state();
+	std::vector<Binding>& current = st.current;
+	SymbolId id = s->symbol();
+	if((size_t)id >= current.size()) current.resize(SymbolTable::size(), Binding{NULL, 0});
+	
+	Binding& b = current[id];
+	int depth = st.marks.size();
+	if(b.scoped != NULL && b.depth == depth){
+		throw VariableRedefinedError(s->name(), b.scoped->typeString());
+	}
+	st.undo.push_back(std::make_pair(id, b));
+	b.scoped = s;
+	b.depth = depth;
+
+	if(!st.loops.empty()){
+		ScopedVariable* v = dynamic_cast<ScopedVariable*>(s);
+		if(v != NULL){
+			for(size_t i=0; i<st.loops.size(); i++) st.loops[i]->declared.push_back(v);
+		}
+	}
+}
+
+void ScopeTable::beginLoop(LoopVariables* vars)
+{
+	state().loops.push_back(vars);
+}
+
+void ScopeTable::endLoop()
+{
+	state().loops.pop_back();
+}
+
+void ScopeTable::reference(ScopedVariable* v)
+{
+	std::vector<LoopVariables*>& loops = state().loops;
+	for(size_t i=0; i<loops.size(); i++) loops[i]->used.push_back(v);
+}
+
+void ScopeTable::write(ScopedVariable* v)
+{
+	std::vector<LoopVariables*>& loops = state().loops;
+	for(size_t i=0; i<loops.size(); i++) loops[i]->written.push_back(v);
+}
+
+Scoped* ScopeTable::lookup(SymbolId id)
+{
+	Stats::count(COUNT_SCOPE_LOOKUPS);
+	std::vector<Binding>& current = state().current;
+	if((size_t)id >= current.size()) return NULL;
+	return current[id].scoped;
 }
 
 int Registerable::getStackLocation(){
@@ -60,7 +134,8 @@ void Registerable::use(int r)
 	}
 	else if(!inReg)
 	{
-		CodeGen::push(new StackOp(false, r, getStackLocation()));
+		Stats::count(COUNT_RELOADS);
+		CodeGen::push(StackOp(false, r, getStackLocation()));
 	}
 
 	inReg = true;
@@ -70,7 +145,8 @@ void Registerable::use(int r)
 void Registerable::store()
 {
 	inReg = false;
-	CodeGen::push(new StackOp(true, getReg(), getStackLocation()));
+	Stats::count(COUNT_SPILLS);
+	CodeGen::push(StackOp(true, getReg(), getStackLocation()));
 }
 
 void Registerable::unregister()
@@ -2,22 +2,27 @@
 #define TREE_H
 
 #include "Symbol.h"
+#include "Arena.hpp"
 #include <vector>
 #include "Parserbase.h"
 #include "Exception.h"
+#include "Stats.hpp"
 #include <map>
 #include <memory>
 
 /*
 Base class for objects that can be accessed within a scope
 */
-class Scoped
+class Scoped: public ArenaObject
 {
 	protected:
-	std::string identifier;
+	SymbolId identifier;
 
 	public:
-		std::string name(){
+		const std::string& name() const{
+			return SymbolTable::name(identifier);
+		}
+		SymbolId symbol() const{
 			return identifier;
 		}
 		virtual std::string typeString()=0;
@@ -66,6 +71,8 @@ class Registerable
 	
 	virtual int getSize() = 0;
 	virtual std::string getNameInfo() = 0;
+	//Whether the value may still be needed after a call
+	virtual bool outlivesCalls(){return true;}
 	
 	int getReg(){return regLoc;}
 	int getStackLocation();
@@ -80,6 +87,7 @@ class TemporaryValue: public Registerable{
 	~TemporaryValue();
 	int getSize(){return 4;}
 	std::string getNameInfo(){return "<temp>";}
+	bool outlivesCalls(){return false;}
 
 	template<class... Args>
 	static std::shared_ptr<TemporaryValue> create(Args&&... args){
@@ -108,7 +116,7 @@ class ScopedFunction: public Scoped
 	public:
 	std::string label;
 
-	ScopedFunction(std::string i)
+	ScopedFunction(SymbolId i)
 	{
 		identifier = i;
 		label = ".F" + label;
@@ -116,34 +124,86 @@ class ScopedFunction: public Scoped
 	std::string typeString(){return "Function";}
 };
 
-class Branch
+/*
+Variables a loop refers to, collected while it is resolved. A variable is
+listed in used once for every reference to it in the condition, increment
+or body, in written once for every assignment to it there, and in declared
+if the body declares it.
+*/
+struct LoopVariables
+{
+	std::vector<ScopedVariable*> used;
+	std::vector<ScopedVariable*> written;
+	std::vector<ScopedVariable*> declared;
+};
+
+/*
+Names visible while resolving the tree. Each symbol's current binding lives
+in one flat array indexed by SymbolId; declaring a name saves the binding it
+shadows in an undo log, and leaving a scope replays the log back to where
+the scope began. Lookups, scope entry and exit are constant time per name.
+*/
+class ScopeTable
+{
+	struct Binding
+	{
+		Scoped* scoped;
+		int depth;	//Scope nesting level the name was declared at
+	};
+
+	public:
+	struct State
+	{
+		std::vector<Binding> current;
+		std::vector<std::pair<SymbolId, Binding> > undo;
+		std::vector<size_t> marks;	//undo.size() when each open scope began
+		std::vector<LoopVariables*> loops;	//Loops being resolved, innermost last
+	};
+
+	private:
+	static State& state();
+
+	public:
+	static void begin();
+	static void end();
+
+	static void declare(Scoped* s);
+	static Scoped* lookup(SymbolId id);	//NULL if the name is not visible
+
+	//References and declarations up to endLoop are added to vars, and to those of any enclosing loop
+	static void beginLoop(LoopVariables* vars);
+	static void endLoop();
+	static void reference(ScopedVariable* v);
+	static void write(ScopedVariable* v);	//Of an assignment to v, after the reference
+};
+
+class Branch: public ArenaObject
 {
 	protected:
 	Branch* parent;
-	std::map<std::string, Scoped*> vars;
-	bool pulled;
-	bool pullSS;
 	
 	public:
-	std::vector<Branch*> scopeSearch;	//Scopes to search before searching parent
-
 	Branch():
-		parent(NULL),
-		pulled(false),
-		pullSS(false)
+		parent(NULL)
 	{}
 
 
 	virtual std::string format()=0;
 	virtual void genCode() = 0;
+	
+	//Bind names to their declarations, run once on the whole tree before genCode
+	virtual void resolve(){}
+	
 	virtual void setParent(Branch* p){
 		parent = p;
 	}
+	Branch* getParent(){return parent;}
 	
 	template<typename T>
 	void dynamic_assign(T& to, Branch* from)
 	{
 		assert(from != NULL);
+		Stats::count(COUNT_DYNAMIC_ASSIGN);
 		T casted = dynamic_cast<T>(from);
 		assert(casted != NULL);
 		to = casted;
@@ -151,81 +211,6 @@ class Branch
 		to->setParent(this);
 	}
 	
-	Scoped* getScope(std::string s)
-	{
-		if(vars.find(s) != vars.end()){
-			return vars[s];
-		}
-		for(size_t i=0; i<scopeSearch.size(); i++)
-		{
-			Scoped* sc = scopeSearch[i]->searchScope(s);
-			if (sc!=NULL) {
-				//addScope(sc);
-				return sc;
-			}
-		}
-		if(parent != NULL){
-			Scoped* sc = parent->getScope(s);
-			//addScope(sc);
-			return sc;
-		}
-		//pullScope();
-		if(vars.find(s) != vars.end()){
-			return vars[s];
-		}
-		throw NotInScopeException(s);
-	}
-	
-	Scoped* searchScope(std::string s)
-	{
-		if(vars.find(s) != vars.end()){
-			return vars[s];
-		}
-		for(size_t i=0; i<scopeSearch.size(); i++)
-		{
-			Scoped* sc = scopeSearch[i]->searchScope(s);
-			if (sc!=NULL) return sc;
-		}
-		return NULL;
-	}
-	
-	void addScope(Scoped* s)
-	{
-		if(vars.find(s->name()) != vars.end()){
-			throw VariableRedefinedError(s->name(), s->typeString());
-		}
-		vars[s->name()] = s;
-	}
-/*
-	std::map<std::string, Scoped*>& pullScope()
-	{
-		if(!pulled)
-		{
-			if(parent!=NULL)
-			{
-				auto parentScope = parent->pullScope();
-				vars.insert(parentScope.begin(), parentScope.end());
-			}
-			pullScopeSearch();
-			pulled = true;
-		}
-		return vars;
-	}
-	
-	std::map<std::string, Scoped*>& pullScopeSearch()
-	{
-		if(!pullSS)
-		{
-			for(size_t i=0; i<scopeSearch.size(); i++)
-			{
-				auto parentScope = scopeSearch[i]->pullScopeSearch();
-				vars.insert(parentScope.begin(), parentScope.end());
-			}
-			pullSS = true;
-		}
-		return vars;
-	}
-	*/
 	virtual ~Branch(){}
 };
 
@@ -258,6 +243,8 @@ public:
 		type = i;
 	}
 
+	int getType(){return type;}
+
 	
 	std::string format()
 	{
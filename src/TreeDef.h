@@ -1 +1,35 @@
+#ifndef TREEDEF_H
+#define TREEDEF_H
+
+#include <cstddef>
+
 class Branch;
+
+/*
+Semantic value of a grammar symbol. Nonterminals carry their tree node;
+IDENTIFIER tokens carry their SymbolId and I_CONSTANT tokens their decoded
+value, both in value.
+*/
+struct SemanticValue
+{
+	Branch* node;
+	int value;
+
+	SemanticValue(Branch* b = NULL):
+		node(b), value(0)
+	{}
+
+	static SemanticValue token(int v)
+	{
+		SemanticValue s;
+		s.value = v;
+		return s;
+	}
+
+	operator Branch*() const
+	{
+		return node;
+	}
+};
+
+#endif
@@ -4,7 +4,7 @@
 
 %baseclass-preinclude TreeDef.h
 
-%stype Branch*
+%stype SemanticValue
 
 %token	IDENTIFIER I_CONSTANT F_CONSTANT STRING_LITERAL FUNC_NAME SIZEOF
 %token	PTR_OP INC_OP DEC_OP LEFT_OP RIGHT_OP LE_OP GE_OP EQ_OP NE_OP
@@ -27,7 +27,7 @@
 %%
 
 primary_expression
-	: IDENTIFIER  {std::string i = SymbolStore::pop();	$$ = new Identifier(i);}
+	: IDENTIFIER  {$$ = new Identifier($1.value);}
 	| constant	{$$ = $1;}
 	| string	{$$ = $1;}
 	| '(' expression ')'	{$$ = new BracketedExpression($2);}
@@ -35,7 +35,7 @@ primary_expression
 	;
 
 constant
-	: I_CONSTANT		{$$ = new Constant(SymbolStore::pop(),I_CONSTANT);}
+	: I_CONSTANT		{$$ = new Constant($1.value);}
 	| F_CONSTANT		{$$ = new Constant(d_scanner.matched(),F_CONSTANT);}
 	| ENUMERATION_CONSTANT	/* after it has been defined as such */
 	;
@@ -78,7 +78,7 @@ postfix_expression
 
 argument_expression_list
 	: assignment_expression	{$$ = new ArgumentExpressionList($1);}
-	| argument_expression_list ',' assignment_expression	{$$ = $1; dynamic_cast<ArgumentExpressionList*>($$)->extend(new ArgumentExpressionList($3));}
+	| argument_expression_list ',' assignment_expression	{$$ = $1; dynamic_cast<ArgumentExpressionList*>($$.node)->extend(new ArgumentExpressionList($3));}
 	;
 
 unary_expression
@@ -209,15 +209,15 @@ declaration_specifiers
 	| type_specifier	{$$ = $1;}
 	| type_qualifier declaration_specifiers
 	| type_qualifier
-	| function_specifier declaration_specifiers
-	| function_specifier
+	| function_specifier declaration_specifiers	{$$ = $1; dynamic_cast<FunctionSpec*>($1.node)->extend($2);}
+	| function_specifier	{$$ = $1;}
 	| alignment_specifier declaration_specifiers
 	| alignment_specifier
 	;
 
 init_declarator_list
 	: init_declarator	{$$ = ($1);}
-	| init_declarator_list ',' init_declarator	{$$ = $1; (dynamic_cast<InitDeclarator*>($1))->extend($3);}
+	| init_declarator_list ',' init_declarator	{$$ = $1; (dynamic_cast<InitDeclarator*>($1.node))->extend($3);}
 	;
 
 init_declarator
@@ -323,8 +323,8 @@ type_qualifier
 	;
 
 function_specifier
-	: INLINE
-	| NORETURN
+	: INLINE	{$$ = new FunctionSpec(ParserBase::INLINE);}
+	| NORETURN	{$$ = new FunctionSpec(ParserBase::NORETURN);}
 	;
 
 alignment_specifier
@@ -338,7 +338,7 @@ declarator
 	;
 
 direct_declarator
-	: IDENTIFIER	{$$ = new DirectDeclaratorBase(d_scanner.matched());}
+	: IDENTIFIER	{$$ = new DirectDeclaratorBase($1.value);}
 	| '(' declarator ')'	{throw UnimplementedException("Matching ( declarator )");}
 	| direct_declarator '[' ']'	{throw UnimplementedException("Matching declarator [ ]");}
 	| direct_declarator '[' '*' ']'	{throw UnimplementedException("Matching declarator [ * ]");}
@@ -476,7 +476,7 @@ compound_statement
 
 block_item_list
 	: block_item	{$$ = ($1);}
-	| block_item_list block_item {$$ = ($1); dynamic_cast<BlockItem*>($1)->extend($2);}
+	| block_item_list block_item {$$ = ($1); dynamic_cast<BlockItem*>($1.node)->extend($2);}
 	;
 
 block_item
@@ -514,7 +514,7 @@ jump_statement
 
 translation_unit
 	: external_declaration	{TranslationUnit* tu = new TranslationUnit($1); $$ = tu; TopBranch::set(tu);}
-	| translation_unit external_declaration	{$$ = $1; dynamic_cast<TranslationUnit*>($$)->extend(new TranslationUnit($2));}
+	| translation_unit external_declaration	{$$ = $1; dynamic_cast<TranslationUnit*>($$.node)->extend(new TranslationUnit($2));}
 	;
 
 external_declaration
@@ -2518,31 +2518,31 @@ try
         case 45:
         {
 #line 70 "grammar.l"
-            { SymbolStore::push(matched()); return Parser::IDENTIFIER;}
+            { d_value = SymbolTable::intern(span()); return Parser::IDENTIFIER;}
         }
         break;
         case 46:
         {
 #line 72 "grammar.l"
-            { SymbolStore::push(matched()); return Parser::I_CONSTANT; }
+            { d_value = parseInt(span()); return Parser::I_CONSTANT; }
         }
         break;
         case 47:
         {
 #line 73 "grammar.l"
-            { SymbolStore::push(matched()); return Parser::I_CONSTANT; }
+            { d_value = parseInt(span()); return Parser::I_CONSTANT; }
         }
         break;
         case 48:
         {
 #line 74 "grammar.l"
-            { SymbolStore::push(matched()); return Parser::I_CONSTANT; }
+            { d_value = parseInt(span()); return Parser::I_CONSTANT; }
         }
         break;
         case 49:
         {
 #line 75 "grammar.l"
-            { SymbolStore::push(matched()); return Parser::I_CONSTANT; }
+            { d_value = parseInt(span()); return Parser::I_CONSTANT; }
         }
         break;
         case 50:
@@ -0,0 +1,414 @@
+#include "Scanner.ih"
+#include <cstring>
+
+/*
+Scanner for source held in memory, used when the input file is mapped.
+It accepts the same tokens as grammar.l, longest match first and the earlier
+rule on a tie, but it walks raw pointers into the buffer: there is no
+per-character virtual input call and token text is never copied unless the
+parser asks for it.
+*/
+
+namespace
+{
+
+struct Keyword
+{
+	char const *text;
+	int token;
+};
+
+// Sorted by strcmp, for binary search
+Keyword const keywords[] = {
+	{"_Alignas", Parser::ALIGNAS},
+	{"_Alignof", Parser::ALIGNOF},
+	{"_Atomic", Parser::ATOMIC},
+	{"_Bool", Parser::BOOL},
+	{"_Complex", Parser::COMPLEX},
+	{"_Generic", Parser::GENERIC},
+	{"_Imaginary", Parser::IMAGINARY},
+	{"_Noreturn", Parser::NORETURN},
+	{"_Static_assert", Parser::STATIC_ASSERT},
+	{"_Thread_local", Parser::THREAD_LOCAL},
+	{"__func__", Parser::FUNC_NAME},
+	{"auto", Parser::AUTO},
+	{"break", Parser::BREAK},
+	{"case", Parser::CASE},
+	{"char", Parser::CHAR},
+	{"const", Parser::CONST},
+	{"continue", Parser::CONTINUE},
+	{"default", Parser::DEFAULT},
+	{"do", Parser::DO},
+	{"double", Parser::DOUBLE},
+	{"else", Parser::ELSE},
+	{"enum", Parser::ENUM},
+	{"extern", Parser::EXTERN},
+	{"float", Parser::FLOAT},
+	{"for", Parser::FOR},
+	{"goto", Parser::GOTO},
+	{"if", Parser::IF},
+	{"inline", Parser::INLINE},
+	{"int", Parser::INT},
+	{"long", Parser::LONG},
+	{"register", Parser::REGISTER},
+	{"restrict", Parser::RESTRICT},
+	{"return", Parser::RETURN},
+	{"short", Parser::SHORT},
+	{"signed", Parser::SIGNED},
+	{"sizeof", Parser::SIZEOF},
+	{"static", Parser::STATIC},
+	{"struct", Parser::STRUCT},
+	{"switch", Parser::SWITCH},
+	{"typedef", Parser::TYPEDEF},
+	{"union", Parser::UNION},
+	{"unsigned", Parser::UNSIGNED},
+	{"void", Parser::VOID},
+	{"volatile", Parser::VOLATILE},
+	{"while", Parser::WHILE}
+};
+
+inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+inline bool isOct(char c)
+{
+	return c >= '0' && c <= '7';
+}
+
+inline bool isHex(char c)
+{
+	return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline bool isLetter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isIdentifierChar(char c)
+{
+	return isLetter(c) || isDigit(c);
+}
+
+// {WS}
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\v' || c == '\n' || c == '\f';
+}
+
+//Keyword token for an identifier, 0 if it is not one
+int keyword(char const *s, size_t n)
+{
+	size_t lo = 0;
+	size_t hi = sizeof(keywords) / sizeof(keywords[0]);
+	while(lo < hi){
+		size_t mid = (lo + hi) / 2;
+		int c = strncmp(s, keywords[mid].text, n);
+		if(c == 0 && keywords[mid].text[n] != '\0') c = -1;
+		if(c == 0) return keywords[mid].token;
+		if(c < 0) hi = mid;
+		else lo = mid + 1;
+	}
+	return 0;
+}
+
+template<bool (*Pred)(char)>
+char const *skip(char const *p, char const *e)
+{
+	while(p < e && Pred(*p)) p++;
+	return p;
+}
+
+// {IS}
+char const *intSuffix(char const *p, char const *e)
+{
+	char const *q = p;
+	bool u = q < e && (*q == 'u' || *q == 'U');
+	if(u) q++;
+	if(q < e && (*q == 'l' || *q == 'L')){
+		q += (q + 1 < e && q[1] == q[0]) ? 2 : 1;
+		if(!u && q < e && (*q == 'u' || *q == 'U')) q++;
+	}
+	return q;
+}
+
+// {FS}
+char const *floatSuffix(char const *p, char const *e)
+{
+	if(p < e && (*p == 'f' || *p == 'F' || *p == 'l' || *p == 'L')) return p + 1;
+	return p;
+}
+
+// {E} or {P}, returns p if there is no complete exponent
+char const *exponent(char const *p, char const *e, char marker)
+{
+	if(p >= e || (*p | 0x20) != marker) return p;
+	char const *q = p + 1;
+	if(q < e && (*q == '+' || *q == '-')) q++;
+	char const *d = skip<isDigit>(q, e);
+	return d == q ? p : d;
+}
+
+/*
+Integer or floating constant starting at p (a digit, or a '.' followed by
+one). Tries every numeric rule and keeps the longest; integer rules come
+first in grammar.l so they win ties.
+*/
+char const *number(char const *p, char const *e, int &token)
+{
+	char const *intEnd = p;
+	char const *floatEnd = p;
+
+	if(p + 1 < e && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')){
+		char const *h = skip<isHex>(p + 2, e);
+		bool whole = h > p + 2;
+		if(whole) intEnd = intSuffix(h, e);
+
+		char const *frac = h;
+		bool valid = whole;
+		if(h < e && *h == '.'){
+			frac = skip<isHex>(h + 1, e);
+			valid = whole || frac > h + 1;
+		}
+		char const *x = exponent(frac, e, 'p');
+		if(valid && x > frac) floatEnd = floatSuffix(x, e);
+	}
+
+	//"0x" without digits is an octal 0 followed by an identifier
+	if(intEnd == p){
+		if(*p == '0') intEnd = intSuffix(skip<isOct>(p + 1, e), e);
+		else if(isDigit(*p)) intEnd = intSuffix(skip<isDigit>(p, e), e);
+	}
+
+	char const *d = skip<isDigit>(p, e);
+	if(d < e && *d == '.'){
+		char const *frac = skip<isDigit>(d + 1, e);
+		if(d > p || frac > d + 1){
+			char const *f = floatSuffix(exponent(frac, e, 'e'), e);
+			if(f > floatEnd) floatEnd = f;
+		}
+	}
+	else if(d > p){
+		char const *x = exponent(d, e, 'e');
+		if(x > d){
+			char const *f = floatSuffix(x, e);
+			if(f > floatEnd) floatEnd = f;
+		}
+	}
+
+	if(floatEnd > intEnd){
+		token = Parser::F_CONSTANT;
+		return floatEnd;
+	}
+	token = Parser::I_CONSTANT;
+	return intEnd;
+}
+
+// {ES} starting at the backslash, returns p if it is not a valid escape
+char const *escape(char const *p, char const *e)
+{
+	if(p + 1 >= e) return p;
+	char c = p[1];
+	if(c != '\0' && strchr("'\"?\\abfnrtv", c)) return p + 2;
+	if(isOct(c)){
+		char const *q = p + 2;
+		while(q < e && q < p + 4 && isOct(*q)) q++;
+		return q;
+	}
+	if(c == 'x'){
+		char const *q = skip<isHex>(p + 2, e);
+		return q > p + 2 ? q : p;
+	}
+	return p;
+}
+
+/*
+Quoted character or string body starting at the opening quote. Returns the
+position after the closing quote, or p if the literal is not terminated on
+this line.
+*/
+char const *quoted(char const *p, char const *e, char quote)
+{
+	char const *q = p + 1;
+	while(q < e && *q != quote){
+		if(*q == '\n') return p;
+		if(*q == '\\'){
+			char const *n = escape(q, e);
+			if(n == q) return p;
+			q = n;
+		}
+		else q++;
+	}
+	return q < e ? q + 1 : p;
+}
+
+// {SP}
+size_t stringPrefix(char const *p, char const *e)
+{
+	if(p < e && *p == 'u') return (p + 1 < e && p[1] == '8') ? 2 : 1;
+	if(p < e && (*p == 'U' || *p == 'L')) return 1;
+	return 0;
+}
+
+// ({SP}?\"([^"\\\n]|{ES})*\"{WS}*)+ , returns p if there is none
+char const *stringLiteral(char const *p, char const *e)
+{
+	char const *q = p;
+	while(true){
+		char const *open = q + stringPrefix(q, e);
+		if(open >= e || *open != '"') break;
+		char const *close = quoted(open, e, '"');
+		if(close == open) break;
+		q = skip<isSpace>(close, e);
+	}
+	return q;
+}
+
+//Operators and punctuation, 0 if c does not start one
+int punctuator(char const *p, char const *e, size_t &len)
+{
+	char c1 = p + 1 < e ? p[1] : 0;
+	char c2 = p + 2 < e ? p[2] : 0;
+
+	len = 2;
+	switch(*p){
+		case '.':
+			if(c1 == '.' && c2 == '.'){len = 3; return Parser::ELLIPSIS;}
+			break;
+		case '>':
+			if(c1 == '>' && c2 == '='){len = 3; return Parser::RIGHT_ASSIGN;}
+			if(c1 == '>') return Parser::RIGHT_OP;
+			if(c1 == '=') return Parser::GE_OP;
+			break;
+		case '<':
+			if(c1 == '<' && c2 == '='){len = 3; return Parser::LEFT_ASSIGN;}
+			if(c1 == '<') return Parser::LEFT_OP;
+			if(c1 == '=') return Parser::LE_OP;
+			if(c1 == '%') return '{';
+			if(c1 == ':') return '[';
+			break;
+		case '+':
+			if(c1 == '=') return Parser::ADD_ASSIGN;
+			if(c1 == '+') return Parser::INC_OP;
+			break;
+		case '-':
+			if(c1 == '=') return Parser::SUB_ASSIGN;
+			if(c1 == '-') return Parser::DEC_OP;
+			if(c1 == '>') return Parser::PTR_OP;
+			break;
+		case '*':
+			if(c1 == '=') return Parser::MUL_ASSIGN;
+			break;
+		case '/':
+			if(c1 == '=') return Parser::DIV_ASSIGN;
+			break;
+		case '%':
+			if(c1 == '=') return Parser::MOD_ASSIGN;
+			if(c1 == '>') return '}';
+			break;
+		case '&':
+			if(c1 == '=') return Parser::AND_ASSIGN;
+			if(c1 == '&') return Parser::AND_OP;
+			break;
+		case '^':
+			if(c1 == '=') return Parser::XOR_ASSIGN;
+			break;
+		case '|':
+			if(c1 == '=') return Parser::OR_ASSIGN;
+			if(c1 == '|') return Parser::OR_OP;
+			break;
+		case '=':
+			if(c1 == '=') return Parser::EQ_OP;
+			break;
+		case '!':
+			if(c1 == '=') return Parser::NE_OP;
+			break;
+		case ':':
+			if(c1 == '>') return ']';
+			break;
+	}
+
+	len = 1;
+	if(*p != '\0' && strchr(";{},:=()[].&!~-+*/%<>^|?", *p)) return *p;
+	return 0;
+}
+
+}
+
+int Scanner::lexBuffer()
+{
+	char const *e = d_end;
+
+	while(true){
+		char const *p = skip<isSpace>(d_pos, e);
+		d_pos = p;
+		if(p == e) return bufferToken(p, 0);
+
+		char c = *p;
+		char c1 = p + 1 < e ? p[1] : 0;
+
+		// //-comments and preprocessor lines run to the end of the line
+		if((c == '/' && c1 == '/') || c == '#'){
+			char const *nl = static_cast<char const *>(memchr(p, '\n', e - p));
+			d_pos = nl ? nl : e;
+			continue;
+		}
+
+		if(c == '/' && c1 == '*'){
+			char const *q = p + 2;
+			while(q + 1 < e && !(q[0] == '*' && q[1] == '/')) q++;
+			d_pos = q + 1 < e ? q + 2 : e;
+			continue;
+		}
+
+		if(isLetter(c)){
+			char const *q = skip<isIdentifierChar>(p + 1, e);
+			size_t n = q - p;
+
+			// u8"..", L'x' and friends are literals, not identifiers
+			if(q < e && *q == '"' && stringPrefix(p, e) == n){
+				char const *s = stringLiteral(p, e);
+				if(s > p) return bufferToken(s, Parser::STRING_LITERAL);
+			}
+			if(q < e && *q == '\'' && n == 1 && (c == 'u' || c == 'U' || c == 'L')){
+				char const *s = quoted(q, e, '\'');
+				if(s > q + 2){
+					d_value = parseInt(TokenSpan{p, size_t(s - p)});
+					return bufferToken(s, Parser::I_CONSTANT);
+				}
+			}
+
+			if(int k = keyword(p, n)) return bufferToken(q, k);
+			d_value = SymbolTable::intern(p, n);
+			return bufferToken(q, Parser::IDENTIFIER);
+		}
+
+		if(isDigit(c) || (c == '.' && isDigit(c1))){
+			int token;
+			char const *q = number(p, e, token);
+			if(token == Parser::I_CONSTANT) d_value = parseInt(TokenSpan{p, size_t(q - p)});
+			return bufferToken(q, token);
+		}
+
+		if(c == '"'){
+			char const *s = stringLiteral(p, e);
+			if(s > p) return bufferToken(s, Parser::STRING_LITERAL);
+		}
+		else if(c == '\''){
+			char const *s = quoted(p, e, '\'');
+			if(s > p + 2){
+				d_value = parseInt(TokenSpan{p, size_t(s - p)});
+				return bufferToken(s, Parser::I_CONSTANT);
+			}
+		}
+		else{
+			size_t len;
+			if(int t = punctuator(p, e, len)) return bufferToken(p + len, t);
+		}
+
+		// discard bad characters
+		d_pos = p + 1;
+	}
+}
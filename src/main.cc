@@ -1,41 +1,210 @@
 #include "Parser.h"
-#include "Allocation.hpp"
+#include "Compilation.hpp"
 #include "Branches.h"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Stats.hpp"
 #include <ostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-TranslationUnit* topLevel;
+// Messages about one file are printed whole, whichever thread reports them
+static std::mutex reportLock;
 
-int main(int argc, char **argv)
+static void report(const std::string& file, const std::string& message)
 {
-  if(argc!=5 || strcmp("-S", argv[1])!=0 || strcmp("-c", argv[2])!=0){
-    std::cout << "Invalid arguments" << std::endl;
-    return 1;  
+  std::lock_guard<std::mutex> l(reportLock);
+  std::cout << file << ": " << message << std::endl;
+}
+
+// dir/foo.c -> foo.s, in the working directory like cc -S
+static std::string assemblyName(const std::string& in)
+{
+  size_t slash = in.find_last_of('/');
+  std::string base = slash == std::string::npos ? in : in.substr(slash + 1);
+  size_t dot = base.find_last_of('.');
+  if(dot != std::string::npos && dot > 0) base.erase(dot);
+  return base + ".s";
+}
+
+// The parser pulls tokens one at a time, and timing each one would cost more
+// than scanning it. For --time-report the scanner gets a pass of its own over
+// the mapped input, and that time is taken off the parse. Streamed input can
+// only be read once, so its scanning stays counted in the parse.
+static void timeScan(const MappedFile& source)
+{
+  std::ifstream none;
+  Scanner scanner(none);
+  scanner.setBuffer(source.begin(), source.end());
+  
+  Stats::Timer time(PHASE_SCAN);
+  while(scanner.lex() != 0)
+	;
+}
+
+// Counters and timers of a file are added to the totals however it ends
+struct AddStats
+{
+  Compilation& unit;
+  ~AddStats()
+  {
+	if(Stats::timing || Stats::counting) Stats::addFile(unit);
+  }
+};
+
+// Translate one source file to assembly, false if it failed
+static bool compileFile(const std::string& inName, const std::string& outName, bool useMmap, ThreadPool& pool)
+{
+  // Regular files are scanned straight out of a read-only mapping; anything
+  // else (or --no-mmap) goes through the stream scanner
+  MappedFile source;
+  std::ifstream input;
+  
+  if(!useMmap || !source.open(inName.c_str())){
+    input.open(inName);
+    if(!input){
+	  report(inName, "Invalid input file");
+	  return false;
+    }
   }
   
-  std::ifstream input(argv[4]);
+  // Every node and table of the unit lives here until we are done with it
+  Compilation unit;
+  Compilation::Scope useUnit(unit);
+  unit.pool = &pool;	// Functions of the unit are generated in parallel too
+  AddStats addStats = {unit};
   
-  if(!input){
-	std::cout << "Invalid input file" << std::endl;
+  try{
+	if(Stats::timing && source.isOpen()) timeScan(source);
+	
+	Parser parser(input);
+	if(source.isOpen())
+	  parser.setBuffer(source.begin(), source.end());
+
+	int parsed;
+	{
+	  Stats::Timer time(PHASE_PARSE);
+	  parsed = parser.parse();
+	}
+	PhaseTime& parse = unit.times[PHASE_PARSE];
+	PhaseTime& scan = unit.times[PHASE_SCAN];
+	parse.wall = std::max<int64_t>(0, parse.wall - scan.wall);
+	parse.cpu = std::max<int64_t>(0, parse.cpu - scan.cpu);
+	
+	if(parsed != 0){
+	  report(inName, "Parsing failed");
+	  return false;
+	}
+	
+	if(TopBranch::get()){
+	  {
+		Stats::Timer time(PHASE_RESOLVE);
+		TopBranch::get()->resolve();
+	  }
+	  Stats::Timer time(PHASE_CODEGEN);
+	  TopBranch::get()->genCode();
+	}
+
+	Stats::Timer time(PHASE_DIRECTIVES);
+	CodeGen::pushBegin(StringBin::createDirectives());
+  }
+  catch(std::exception& e){
+	report(inName, e.what());
+	return false;
   }
   
-  std::cin.rdbuf(input.rdbuf());
+  int outfile = open(outName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(outfile < 0){
+	report(outName, "Invalid output file");
+	return false;
+  }
   
+  bool ok;
+  {
+	Stats::Timer time(PHASE_EMIT);
+	AsmWriter writer(outfile);
+	CodeGen::emit(writer);
+	writer.flush();
+	ok = writer.good();
+  }
+  close(outfile);
+  if(!ok) report(outName, "Failed to write output file");
   
-  Parser parser;
+  return ok;
+}
 
-  parser.parse();
+int main(int argc, char **argv)
+{
+  // ucc -S [-j <jobs>] [-c <output>] [--time-report] [--stats] [--regalloc=local|linear] [-O] <input>...,
+  // options may go anywhere
+  bool assemble = false;
+  bool useMmap = true;
+  int jobs = 1;
+  const char* outName = NULL;
+  std::vector<std::string> inputs;
+  bool valid = true;
   
-  if(TopBranch::get())
-	TopBranch::get()->genCode();
-
-  CodeGen::pushBegin(StringBin::createDirectives());
+  for(int i=1; i<argc; i++){
+    if(strcmp("-S", argv[i])==0) assemble = true;
+    else if(strcmp("-c", argv[i])==0 && i+1<argc) outName = argv[++i];
+    else if(strcmp("-j", argv[i])==0 && i+1<argc) jobs = atoi(argv[++i]);
+    else if(strncmp("-j", argv[i], 2)==0 && argv[i][2]) jobs = atoi(argv[i] + 2);
+    else if(strcmp("--no-mmap", argv[i])==0) useMmap = false;
+    else if(strcmp("--time-report", argv[i])==0) Stats::timing = true;
+    else if(strcmp("--stats", argv[i])==0) Stats::counting = true;
+    else if(strcmp("--regalloc=linear", argv[i])==0) RegAlloc::linearScan = true;
+    else if(strcmp("--regalloc=local", argv[i])==0) RegAlloc::linearScan = false;
+    else if(strcmp("-O", argv[i])==0) IrFunction::enabled = true;
+    else if(argv[i][0]!='-') inputs.push_back(argv[i]);
+    else{
+      valid = false;
+      break;
+    }
+  }
+  
+  // -c names a single output, so it can only go with a single input
+  if(!valid || !assemble || inputs.empty() || jobs < 1 || (outName && inputs.size() > 1)){
+    std::cout << "Invalid arguments" << std::endl;
+    return 1;  
+  }
+  
+  // Inputs with the same base name would write the same .s at once
+  std::vector<std::string> outputs;
+  std::map<std::string, size_t> writer;
+  for(size_t i=0; i<inputs.size(); i++){
+	outputs.push_back(outName ? std::string(outName) : assemblyName(inputs[i]));
+	auto claimed = writer.insert(std::make_pair(outputs[i], i));
+	if(!claimed.second){
+	  report(inputs[i], "Output file " + outputs[i] + " is also written for " + inputs[claimed.first->second]);
+	  valid = false;
+	}
+  }
+  if(!valid) return 1;
   
-  std::ofstream outfile(argv[3]);
+  std::atomic<bool> failed(false);
+  {
+	ThreadPool pool(jobs);
+	TaskGroup files(pool);
+	for(size_t i=0; i<inputs.size(); i++){
+	  const std::string& out = outputs[i];
+	  files.run([&, i, out]{
+		if(!compileFile(inputs[i], out, useMmap, pool)) failed = true;
+	  });
+	}
+	files.wait();
+  }
   
-  CodeGen::format(outfile);
+  if(Stats::timing || Stats::counting) Stats::report(std::cerr);
   
-  return 0;
+  return failed ? 1 : 0;
 }
@@ -8520,7 +8520,7 @@ try
         
         case 1:
 #line 30 "grammar.y"
-        {std::string i = SymbolStore::pop(); d_val__ = new Identifier(i);}
+        {d_val__ = new Identifier(vs__(0).value);}
         break;
 
         case 2:
@@ -8545,7 +8545,7 @@ try
 
         case 6:
 #line 38 "grammar.y"
-        {d_val__ = new Constant(SymbolStore::pop(),I_CONSTANT);}
+        {d_val__ = new Constant(vs__(0).value);}
         break;
 
         case 7:
@@ -8666,7 +8666,7 @@ try
 
         case 27:
 #line 81 "grammar.y"
-        {d_val__ = vs__(-2); dynamic_cast<ArgumentExpressionList*>(d_val__)->extend(new ArgumentExpressionList(vs__(0)));}
+        {d_val__ = vs__(-2); dynamic_cast<ArgumentExpressionList*>(d_val__.node)->extend(new ArgumentExpressionList(vs__(0)));}
         break;
 
         case 28:
@@ -9033,9 +9033,7 @@ try
 
         case 98:
 #line 213 "grammar.y"
-        {
-            d_val__ = vs__(-1);
-        }
+        {d_val__ = vs__(-1); dynamic_cast<FunctionSpec*>(vs__(-1).node)->extend(vs__(0));}
         break;
 
         case 99:
@@ -9066,7 +9064,7 @@ try
 
         case 103:
 #line 220 "grammar.y"
-        {d_val__ = vs__(-2); (dynamic_cast<InitDeclarator*>(vs__(-2)))->extend(vs__(0));}
+        {d_val__ = vs__(-2); (dynamic_cast<InitDeclarator*>(vs__(-2).node))->extend(vs__(0));}
         break;
 
         case 104:
@@ -9444,16 +9442,12 @@ try
 
         case 161:
 #line 327 "grammar.y"
-        {
-            d_val__ = vs__(0);
-        }
+        {d_val__ = new FunctionSpec(ParserBase::INLINE);}
         break;
 
         case 162:
 #line 328 "grammar.y"
-        {
-            d_val__ = vs__(0);
-        }
+        {d_val__ = new FunctionSpec(ParserBase::NORETURN);}
         break;
 
         case 163:
@@ -9482,7 +9476,7 @@ try
 
         case 167:
 #line 341 "grammar.y"
-        {d_val__ = new DirectDeclaratorBase(d_scanner.matched());}
+        {d_val__ = new DirectDeclaratorBase(vs__(0).value);}
         break;
 
         case 168:
@@ -9998,7 +9992,7 @@ try
 
         case 247:
 #line 479 "grammar.y"
-        {d_val__ = (vs__(-1)); dynamic_cast<BlockItem*>(vs__(-1))->extend(vs__(0));}
+        {d_val__ = (vs__(-1)); dynamic_cast<BlockItem*>(vs__(-1).node)->extend(vs__(0));}
         break;
 
         case 248:
@@ -10102,7 +10096,7 @@ try
 
         case 267:
 #line 517 "grammar.y"
-        {d_val__ = vs__(-1); dynamic_cast<TranslationUnit*>(d_val__)->extend(new TranslationUnit(vs__(0)));}
+        {d_val__ = vs__(-1); dynamic_cast<TranslationUnit*>(d_val__.node)->extend(new TranslationUnit(vs__(0)));}
         break;
 
         case 268:
@@ -0,0 +1,107 @@
+/*
+Checks Cfg's blocks, dominators and loop nesting tree on the code of two
+nested while loops.
+
+usage: cfgtest
+*/
+#include "Compilation.hpp"
+#include "Cfg.hpp"
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	if(ok) return;
+	std::cout << "failed: " << what << std::endl;
+	failures++;
+}
+
+/*
+    MOV r0, #0          block 0
+outer:                  block 1, outer loop header
+    CMP r0, #10
+    BGE done
+    MOV r1, #0          block 2
+inner:                  block 3, inner loop header
+    CMP r1, #5
+    BGE next
+    ADD r1, r1, #1      block 4
+    B inner
+next:                   block 5
+    ADD r0, r0, #1
+    B outer
+done:                   block 6
+    MOV r0, r1
+*/
+static void nestedLoops()
+{
+	Label outer = LabelAlloc::allocate();
+	Label inner = LabelAlloc::allocate();
+	Label next = LabelAlloc::allocate();
+	Label done = LabelAlloc::allocate();
+	CodeGen::push(MoveBlock(0, Imm(0)));
+	CodeGen::push(LabelBlock(outer));
+	CodeGen::push(CMPBlock(0, Imm(10)));
+	CodeGen::push(BranchBlock(done, GE));
+	CodeGen::push(MoveBlock(1, Imm(0)));
+	CodeGen::push(LabelBlock(inner));
+	CodeGen::push(CMPBlock(1, Imm(5)));
+	CodeGen::push(BranchBlock(next, GE));
+	CodeGen::push(AddBlock(1, 1, Imm(1)));
+	CodeGen::push(BranchBlock(inner));
+	CodeGen::push(LabelBlock(next));
+	CodeGen::push(AddBlock(0, 0, Imm(1)));
+	CodeGen::push(BranchBlock(outer));
+	CodeGen::push(LabelBlock(done));
+	CodeGen::push(MoveBlock(0, FlexSrc(1)));
+}
+
+//The loop with header h, -1 if there is none
+static int headed(const Cfg& cfg, int h)
+{
+	for(size_t l=0; l<cfg.loops().size(); l++){
+		if(cfg.loops()[l].header == h) return l;
+	}
+	return -1;
+}
+
+int main()
+{
+	Compilation unit;
+	Compilation::Scope useUnit(unit);
+	nestedLoops();
+
+	Cfg cfg(CodeGen::instructions(), 0, CodeGen::size());
+	cfg.analyse();
+
+	const std::vector<Cfg::Block>& blocks = cfg.blocks();
+	check(blocks.size() == 7, "seven blocks");
+	check(cfg.blockOf(0) == 0 && cfg.blockOf(9) == 4 && cfg.blockOf(14) == 6, "blockOf");
+	check(blocks[1].succ == std::vector<int>({6, 2}), "successors of the outer header");
+	check(blocks[3].pred == std::vector<int>({2, 4}), "predecessors of the inner header");
+
+	const int idom[] = {-1, 0, 1, 2, 3, 3, 1};
+	for(int b=0; b<7; b++) check(blocks[b].idom == idom[b], "immediate dominators");
+	check(blocks[1].dominated == std::vector<int>({2, 6}) || blocks[1].dominated == std::vector<int>({6, 2}), "dominator tree");
+	check(cfg.dominates(1, 5) && cfg.dominates(3, 4) && !cfg.dominates(4, 5) && !cfg.dominates(2, 6), "dominates");
+	check(cfg.reversePostorder().size() == 7 && cfg.reversePostorder()[0] == 0, "reverse postorder");
+
+	const std::vector<Cfg::Loop>& loops = cfg.loops();
+	check(loops.size() == 2, "two loops");
+	int in = headed(cfg, 3), out = headed(cfg, 1);
+	if(in >= 0 && out >= 0){
+		check(loops[in].parent == out && loops[out].parent == -1, "loop parents");
+		check(loops[out].children == std::vector<int>({in}) && loops[in].children.empty(), "loop children");
+		check(loops[in].depth == 2 && loops[out].depth == 1, "loop depths");
+		check(loops[in].exits == std::vector<int>({5}) && loops[out].exits == std::vector<int>({6}), "loop exits");
+		check(cfg.inLoop(in, 4) && !cfg.inLoop(in, 5) && cfg.inLoop(out, 5) && !cfg.inLoop(out, 6), "inLoop");
+	}
+	else check(false, "loops headed by blocks 1 and 3");
+	const int depth[] = {0, 1, 1, 2, 2, 1, 0};
+	for(int b=0; b<7; b++) check(cfg.loopDepth(b) == depth[b], "loop depth of each block");
+
+	if(failures) return 1;
+	std::cout << "cfgtest passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,15 @@
+// ucc:
+// leaf needs no frame at all; call saves lr and the registers it keeps y in
+// across its calls, without setting up a frame pointer
+int leaf(int x)
+{
+	int a = x + 1;
+	int b = a * 3;
+	return a + b;
+}
+
+int call(int x)
+{
+	int y = leaf(x);
+	return leaf(y) + y;
+}
@@ -0,0 +1,26 @@
+.section .rodata
+.text
+
+    .global leaf
+leaf:
+    ADD r2, r0, #1
+    MOV r1, r2
+    RSB r3, r1, r1, LSL #2
+    MOV r2, r3
+    ADD r3, r1, r2
+    MOV r0, r3
+.leafreturn:
+    MOV r15, r14
+    .global call
+call:
+    STMFD sp!, {r4, r5, r12, r14}
+    MOV r5, r0
+    MOV r0, r5
+    BL leaf
+    MOV r4, r0
+    MOV r0, r4
+    BL leaf
+    ADD r1, r0, r4
+    MOV r0, r1
+.callreturn:
+    LDMFD sp!, {r4, r5, r12, r15}
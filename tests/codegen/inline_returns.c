@@ -0,0 +1,14 @@
+// ucc: -O
+// max has two returns; inlined, they meet in a phi in the caller
+int max(int a, int b)
+{
+	if(a > b){
+		return a;
+	}
+	return b;
+}
+
+int f(int x, int y)
+{
+	return max(x, y) + 1;
+}
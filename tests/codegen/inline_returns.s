@@ -0,0 +1,15 @@
+.section .rodata
+.text
+
+    .global max
+max:
+    CMP r0, r1
+    MOVLE r0, r1
+    MOV r15, r14
+    .global f
+f:
+    CMP r0, r1
+    MOVLE r0, r1
+    ADD r0, r0, #1
+.freturn:
+    MOV r15, r14
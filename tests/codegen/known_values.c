@@ -0,0 +1,24 @@
+// ucc:
+// k is 2 on both arms, so it is still known after the if and the second if
+// folds; j differs between the arms and the loop assigns i, so both are read
+int f(int x)
+{
+	int k;
+	int j;
+	if(x > 0){
+		k = 2;
+		j = 1;
+	}
+	else{
+		k = 2;
+		j = 3;
+	}
+	if(k == 2){
+		x = x + j;
+	}
+	int i = 0;
+	while(i < x){
+		i = i + k;
+	}
+	return i;
+}
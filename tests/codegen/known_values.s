@@ -0,0 +1,38 @@
+.section .rodata
+.text
+
+    .global f
+f:
+    SUB r13, r13, #8
+    MOV r1, #0
+    CMP r0, r1
+    BLE .L1
+    MOV r1, #2
+    MOV r2, #1
+    STR r1, [sp, #4]
+    STR r2, [sp, #0]
+    B .L2
+.L1:
+    LDR r1, [sp, #4]
+    MOV r1, #2
+    LDR r2, [sp, #0]
+    MOV r2, #3
+    STR r1, [sp, #4]
+    STR r2, [sp, #0]
+.L2:
+    LDR r1, [sp, #0]
+    ADD r2, r0, r1
+    MOV r0, r2
+    MOV r2, #0
+    STR r1, [sp, #0]
+.L4:
+    CMP r2, r0
+    BGE .L5
+    ADD r1, r2, #2
+    MOV r2, r1
+    B .L4
+.L5:
+    MOV r0, r2
+.freturn:
+    ADD r13, r13, #8
+    MOV r15, r14
@@ -0,0 +1,12 @@
+// ucc: -O
+// a * b doesn't change in the loop, so it is computed once in front of it
+int f(int a, int b, int n)
+{
+	int s = 0;
+	int i = 0;
+	while(i < n){
+		s = s + a * b;
+		i = i + 1;
+	}
+	return s;
+}
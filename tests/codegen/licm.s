@@ -0,0 +1,18 @@
+.section .rodata
+.text
+
+    .global f
+f:
+    MUL r0, r1, r0
+    MOV r1, #0
+    MOV r3, #0
+.L2:
+    CMP r1, r2
+    BGE .L1
+    ADD r3, r3, r0
+    ADD r1, r1, #1
+    B .L2
+.L1:
+    MOV r0, r3
+.freturn:
+    MOV r15, r14
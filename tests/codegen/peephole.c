@@ -0,0 +1,23 @@
+// ucc:
+// The short arms of both ifs become conditional instructions, and in g the
+// comparison only tested by the if is branched on directly, not stored as 0/1
+int f(int a, int b)
+{
+	int m;
+	if(a < b){
+		m = a;
+	}
+	else{
+		m = b;
+	}
+	return m;
+}
+
+int g(int a, int b)
+{
+	int c = a < b;
+	if(c){
+		return 1;
+	}
+	return 2;
+}
@@ -0,0 +1,25 @@
+.section .rodata
+.text
+
+    .global f
+f:
+    SUB r13, r13, #4
+    CMP r0, r1
+    MOVLT r2, r0
+    STRLT r2, [sp, #0]
+    LDRGE r2, [sp, #0]
+    MOVGE r2, r1
+    STRGE r2, [sp, #0]
+    LDR r2, [sp, #0]
+    MOV r0, r2
+.freturn:
+    ADD r13, r13, #4
+    MOV r15, r14
+    .global g
+g:
+    CMP r0, r1
+    MOVLT r3, #1
+    MOVLT r0, r3
+    MOVGE r3, #2
+    MOVGE r0, r3
+    MOV r15, r14
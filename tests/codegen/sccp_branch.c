@@ -0,0 +1,10 @@
+// ucc: -O
+// SCCP folds k > 2 and the branch it decides, leaving only the taken arm
+int f(int x)
+{
+	int k = 3;
+	if(k > 2){
+		return x + 1;
+	}
+	return x - 1;
+}
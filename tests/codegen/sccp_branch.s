@@ -0,0 +1,8 @@
+.section .rodata
+.text
+
+    .global f
+f:
+    ADD r0, r0, #1
+.freturn:
+    MOV r15, r14
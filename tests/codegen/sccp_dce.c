@@ -0,0 +1,16 @@
+// ucc: -O
+// a and b fold to constants through the phi of the if, and unused is removed;
+// the CMP of the emptied if is still left behind
+int f(int x)
+{
+	int a = 4;
+	int b;
+	if(x > 0){
+		b = a + 1;
+	}
+	else{
+		b = 5;
+	}
+	int unused = x + b;
+	return x + b * a;
+}
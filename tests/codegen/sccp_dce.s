@@ -0,0 +1,9 @@
+.section .rodata
+.text
+
+    .global f
+f:
+    CMP r0, #0
+    ADD r0, r0, #20
+.freturn:
+    MOV r15, r14
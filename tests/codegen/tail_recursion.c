@@ -0,0 +1,9 @@
+// ucc: -O
+// The self tail call becomes a branch back to the top, where n and acc are phis
+int sum(int n, int acc)
+{
+	if(n == 0){
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
@@ -0,0 +1,18 @@
+.section .rodata
+.text
+
+    .global sum
+sum:
+    MOV r2, r0
+.L2:
+    CMP r2, #0
+    BNE .L1
+    MOV r0, r1
+    B .sumreturn
+.L1:
+    SUB r0, r2, #1
+    ADD r1, r1, r2
+    MOV r2, r0
+    B .L2
+.sumreturn:
+    MOV r15, r14
@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Compiles each tests/codegen/name.c with the flags on its first line
+# ("// ucc: -O") and compares the assembly with tests/codegen/name.s.
+# With --update the expected files are rewritten from the output instead,
+# to be checked by hand before they are committed.
+#
+# usage: codegentest.sh <compiler> [--update]
+
+compiler=$1
+update=$2
+dir=$(dirname "$0")/codegen
+out=${TMPDIR:-/tmp}/codegentest.$$.s
+failures=0
+
+for src in "$dir"/*.c; do
+	expected=${src%.c}.s
+	flags=$(head -n 1 "$src" | sed -n 's#^// ucc:##p')
+	rm -f "$out"
+	if ! "$compiler" $flags -S -c "$out" "$src"; then
+		echo "failed: $src does not compile"
+		failures=$((failures + 1))
+	elif [ "$update" = "--update" ]; then
+		cp "$out" "$expected"
+	elif ! diff -u "$expected" "$out"; then
+		echo "failed: $src"
+		failures=$((failures + 1))
+	fi
+done
+rm -f "$out"
+
+if [ $failures -ne 0 ]; then
+	exit 1
+fi
+echo "codegentest passed"
@@ -0,0 +1,27 @@
+# 1 "tokens.c"
+#define TWO 2
+/* Every rule of grammar.l, with the corner cases lexBuffer.cc
+   handles by hand */
+auto break case char const continue default do double else enum extern float for goto
+if inline int long register restrict return short signed sizeof static struct switch typedef
+union unsigned void volatile while _Alignas _Alignof _Atomic _Bool _Complex _Generic _Imaginary
+_Noreturn _Static_assert _Thread_local __func__
+ints integer int_ _x9 whilex x0 iff Int __func__x
+0 7 012 09 123 4294967295 0x1F 0XaBu 10u 10U 10l 10L 10ul 10LLU 10lu 0777L 0x 08
+'a' 'ab' 'abcd' '\n' '\t' '\0' '\101' '\x41' '\x4142' '\'' '\\' '\?' '"' L'x' u'y' U'z' ''
+1e5 1.5 .5 5. 1.5e-3f 2E+7L 0x1p4 0x.8p1 0x1.p2 1.0F
+"plain" "esc\n\t\"\\" "a" "b"   "c" u8"utf" L"wide" u"x" U"y" "oct\101\x41" ""
+"joined"
+  "across lines"
+... >>= <<= += -= *= /= %= &= ^= |= >> << ++ -- -> && || <= >= == !=
+; { <% } %> , : = ( ) [ <: ] :> . & ! ~ - + * / % < > ^ | ?
+a//line comment
+b/* inline */c /**/ d /* spans
+   lines * / ** */ e
+x #not at line start is still consumed
+@ $ ` \ bad characters
+a->b a-->b a+++b a<<=b 1..2 x.y
+	tab	andverticalform
+"unterminated
+'x
+#no newline at the end
\ No newline at end of file
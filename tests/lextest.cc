@@ -0,0 +1,92 @@
+/*
+Scans each input with both scanners, the flexc++ stream scanner generated
+from grammar.l (used with --no-mmap) and the one in lexBuffer.cc that runs
+over a mapped file, and checks they produce the same tokens, text and
+values.
+
+usage: lextest <input.c>...
+*/
+#include "Compilation.hpp"
+#include "Scanner.h"
+#include "Parserbase.h"
+#include "MappedFile.hpp"
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+struct Token
+{
+	int token;
+	std::string text;
+	int value;	//Only kept for tokens that have one
+
+	bool operator!=(const Token& t) const
+	{
+		return token != t.token || text != t.text || value != t.value;
+	}
+};
+
+static void scan(Scanner& scanner, std::vector<Token>& tokens)
+{
+	for(;;){
+		Token t;
+		t.token = scanner.lex();
+		if(t.token == 0) return;
+		t.text = scanner.matched();
+		bool valued = t.token == ParserBase::IDENTIFIER || t.token == ParserBase::I_CONSTANT;
+		t.value = valued ? scanner.value() : 0;
+		tokens.push_back(t);
+	}
+}
+
+static std::ostream& operator<<(std::ostream& out, const Token& t)
+{
+	return out << t.token << " '" << t.text << "' " << t.value;
+}
+
+//Whether both scanners agree on path
+static bool compare(const char* path)
+{
+	std::ifstream input(path);
+	MappedFile source;
+	if(!input || !source.open(path)){
+		std::cout << path << ": can't be read" << std::endl;
+		return false;
+	}
+
+	//Identifiers are interned per unit, so both scan within the same one
+	Compilation unit;
+	Compilation::Scope useUnit(unit);
+
+	std::vector<Token> streamed, mapped;
+	Scanner streamScanner(input);
+	scan(streamScanner, streamed);
+
+	std::ifstream none;
+	Scanner bufferScanner(none);
+	bufferScanner.setBuffer(source.begin(), source.end());
+	scan(bufferScanner, mapped);
+
+	for(size_t i=0; i<streamed.size() && i<mapped.size(); i++){
+		if(streamed[i] != mapped[i]){
+			std::cout << path << ": token " << i << " is " << streamed[i] << " from the stream and " << mapped[i] << " from the mapping" << std::endl;
+			return false;
+		}
+	}
+	if(streamed.size() != mapped.size()){
+		std::cout << path << ": " << streamed.size() << " tokens from the stream and " << mapped.size() << " from the mapping" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	for(int i=1; i<argc; i++){
+		if(!compare(argv[i])) failed++;
+	}
+	if(failed) return 1;
+	std::cout << "lextest passed on " << argc - 1 << " inputs" << std::endl;
+	return 0;
+}